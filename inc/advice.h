@@ -0,0 +1,16 @@
+#pragma once
+
+/**
+ * posix_fadvise() 和 madvise() 的访问模式建议
+ */
+#define POSIX_FADV_NORMAL 0     // 默认访问模式，适度预读
+#define POSIX_FADV_RANDOM 1     // 随机访问，不预读
+#define POSIX_FADV_SEQUENTIAL 2 // 顺序访问，加大预读窗口
+#define POSIX_FADV_WILLNEED 3   // 即将访问，提前读入数据
+#define POSIX_FADV_DONTNEED 4   // 不再访问，提前释放缓存
+
+#define MADV_NORMAL 0     // 默认访问模式
+#define MADV_RANDOM 1     // 随机访问
+#define MADV_SEQUENTIAL 2 // 顺序访问
+#define MADV_WILLNEED 3   // 即将访问
+#define MADV_DONTNEED 4   // 不再访问
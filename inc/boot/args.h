@@ -1,4 +1,10 @@
 #pragma once
 
 #define P_KERNEL_ADDR_START 0x1000 // 存放“内核内存起始地址”参数的地址
-#define P_KERNEL_ADDR_END 0x1004   // 存放“内核内存末尾地址”参数的地址
\ No newline at end of file
+#define P_KERNEL_ADDR_END 0x1004   // 存放“内核内存末尾地址”参数的地址
+#define P_E820_COUNT 0x1008        // 存放 BIOS E820 内存布局条目数量的地址，0 表示 BIOS 不支持 E820
+#define P_E820_MAP 0x100C          // 存放 BIOS E820 内存布局条目的地址，条目依次排列，最多 E820_MAX_ENTRIES 个
+
+#define E820_ENTRY_SIZE 20  // E820 条目大小：64 位起始地址、64 位长度、32 位类型
+#define E820_MAX_ENTRIES 32 // E820 条目数量上限
+#define E820_USABLE 1       // 可用内存的条目类型，其他类型为保留或 ACPI 等区域
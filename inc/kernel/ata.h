@@ -52,4 +52,5 @@
 typedef uint64_t lba_t;
 
 int ata_read(void *dst, lba_t lba, uint16_t count);
-int ata_write(const void *src, lba_t lba, uint16_t count);
\ No newline at end of file
+int ata_write(const void *src, lba_t lba, uint16_t count);
+int ata_busy(void);
\ No newline at end of file
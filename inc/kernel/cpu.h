@@ -0,0 +1,11 @@
+#pragma once
+
+#include "types.h"
+
+// CPUID 1 号功能 EDX 寄存器中的特性标志位
+#define CPU_FEATURE_PSE (1 << 3) // 支持 4 MiB 大页
+#define CPU_FEATURE_TSC (1 << 4) // 支持 rdtsc 指令
+#define CPU_FEATURE_PGE (1 << 13) // 支持全局页
+
+void cpu_init(void);
+int cpu_has_feature(uint32_t feature);
@@ -3,6 +3,7 @@
 #include "types.h"
 #include "kernel/page.h"
 #include "kernel/fs.h"
+#include "kernel/vma.h"
 
 #define ELF_MAGIC 0x464C457FU // 字符串 "\x7FELF" 的等价小端编码整数
 
@@ -58,4 +59,4 @@ typedef struct program_header
 #define PF_W 0x2 // Writeable segment
 #define PF_R 0x4 // Readable segment
 
-uint32_t elf_loader(page_dir_entry *user_page_dir, const char *file_path);
\ No newline at end of file
+uint32_t elf_loader(vm_map *vmas, const char *file_path);
\ No newline at end of file
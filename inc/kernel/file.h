@@ -0,0 +1,33 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/fs.h"
+
+#define NR_OPEN 16 // 每个进程最多打开的文件数量
+#define NR_FILE 64 // 系统最多打开的文件数量
+
+#define RA_PAGES_MAX 4 // 预读缓冲区最大页数
+
+/**
+ * 已打开的文件
+ *
+ * 从 open_file 对象缓存中分配，进程的文件描述符指向表项
+ * fork 后父子进程共享同一表项（包括读写位置）
+ */
+typedef struct open_file
+{
+    file_struct file;
+    uint32_t count;  // 引用计数，为 0 时释放表项
+    off_t pos;       // 读写位置
+    uint32_t advice; // 访问模式建议，POSIX_FADV_*
+    uint8_t *ra_buf; // 预读缓冲区，RA_PAGES_MAX 页，首次预读时申请
+    off_t ra_start;  // 缓冲区数据对应的文件偏移
+    size_t ra_len;   // 缓冲区有效数据量
+} open_file;
+
+void file_init(void);
+open_file *open_file_create(const char *path);
+void open_file_get(open_file *f);
+void open_file_put(open_file *f);
+int open_file_read(open_file *f, void *buf, size_t count);
+int open_file_advise(open_file *f, off_t offset, size_t len, int advice);
@@ -1,11 +1,31 @@
 #pragma once
 
 #include "fat16.h"
+#include "kernel/romfs.h"
+
+// 文件所在的文件系统类型
+#define FS_TYPE_FAT16 0
+#define FS_TYPE_ROMFS 1
 
 typedef struct file_struct
 {
-    fat_dir_entry fat_entry;
+    uint8_t fs_type; // 文件系统类型
+    union
+    {
+        fat_dir_entry fat_entry;        // FAT16 文件条目
+        const romfs_entry *romfs_entry; // romfs 文件条目
+    };
+    /**
+     * FAT16 簇链缓存，clus_map[i] 为文件第 i 个簇的簇号
+     * 由 file_cache_extents() 按需建立，NULL 表示未缓存，此时读取文件需要逐簇查询 FAT 表
+     */
+    uint16_t *clus_map;
+    uint32_t clus_map_len; // 簇链缓存的表项数量
 } file_struct;
 
 int file_open(const char *path, file_struct *out_file);
-size_t file_read(void *dst, off_t offset, size_t size, file_struct *file);
\ No newline at end of file
+void file_close(file_struct *file);
+size_t file_read(void *dst, off_t offset, size_t size, file_struct *file);
+size_t file_size(const file_struct *file);
+int file_cache_extents(file_struct *file);
+void file_drop_extents(file_struct *file);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "types.h"
+
+#define KSM_BUCKETS 256        // 已合并页哈希表的桶数量，必须是 2 的幂
+#define KSM_UNSTABLE_SIZE 1024 // 候选页表的大小，必须是 2 的幂
+#define KSM_SCAN_BATCH 64      // 空闲任务每次扫描的页数
+
+void ksm_init(void);
+int ksm_scan(uint32_t count);
+void ksm_remove(uint32_t p_addr);
+void ksm_info(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "types.h"
+
+#define LZ4_COMPRESS_BOUND(size) ((size) + (size) / 255 + 16) // 压缩输出缓冲区的最小大小
+
+size_t lz4_compress(const void *src, size_t size, void *dst);
+int lz4_decompress(const void *src, size_t src_size, void *dst, size_t dst_capacity);
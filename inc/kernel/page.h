@@ -3,9 +3,25 @@
 #include "types.h"
 
 #define PAGE_SIZE (1U << 12) // 单个页面大小 4 KiB
+#define LARGE_PAGE_SIZE (1U << 22) // PSE 大页大小 4 MiB，即一个页目录项映射的范围
+#define KERNEL_SPACE_END 0x40000000U // 内核空间末尾（1 GiB），用户程序从此处开始
+#define KMAP_BASE (KERNEL_SPACE_END - LARGE_PAGE_SIZE) // 临时映射窗口，占用内核空间的最后 4 MiB
+#define KMAP_SLOTS (LARGE_PAGE_SIZE / PAGE_SIZE)       // 临时映射窗口的页数
+#define VMALLOC_END KMAP_BASE                              // vmalloc 区域末尾，紧接临时映射窗口
+#define VMALLOC_START (VMALLOC_END - 16 * LARGE_PAGE_SIZE) // vmalloc 区域起始，共 64 MiB
+#define LOWMEM_END VMALLOC_START // 低端内存末尾，以下的物理内存恒等映射，以上的是高端内存，要通过 kmap 访问
+#define PHYS_MEM_END 0xFFFFF000U // 可用物理内存的上限，32 位页表项只能映射 4 GiB 以下的物理内存
 #define page_dir_index(addr) ((addr) >> 22)
 #define page_table_index(addr) (((addr) >> 12) & 0x3FF)
 
+#define PTE_AVL_COW 0x1 // 页表项 avl 字段中的写时复制标志，页被共享且原本可写
+#define PTE_AVL_SWAP 0x2 // 页表项 avl 字段中的换出标志，页已写入交换区，地址字段为交换槽位号
+
+// 缺页异常错误码
+#define PF_ERR_PRESENT 0x1 // 0 页不存在，1 违反页级保护
+#define PF_ERR_WRITE 0x2   // 0 读访问，1 写访问
+#define PF_ERR_USER 0x4    // 0 内核态访问，1 用户态访问
+
 extern uint32_t kernel_area_page_dir_end_index;
 
 typedef struct page_dir_entry
@@ -38,9 +54,20 @@ typedef struct page_tabel_entry
     uint32_t addr : 20;
 } __attribute__((packed)) page_tabel_entry;
 
+struct tlb_batch; // 定义在 kernel/tlb.h，tlb.h 依赖本文件
+
+page_dir_entry *get_kernel_page_dir(void);
 page_dir_entry *create_user_page_dir(void);
-uint32_t map_physical_page(page_dir_entry *page_dir, uint32_t phys_addr, uint8_t us, uint8_t rw);
 int map_physical_page_to_linear(page_dir_entry *page_dir, uint32_t phys_addr, uint32_t linear_addr, uint8_t us, uint8_t rw);
 void switch_page_dir(const page_dir_entry *user_page_dir);
 int copy_page_dir_and_memory(page_dir_entry *dst_page_dir, const page_dir_entry *src_page_dir);
 void free_user_page_dir(page_dir_entry *page_dir);
+void release_user_page(uint32_t addr);
+int page_cow_fault(page_dir_entry *page_dir, uint32_t addr);
+page_tabel_entry *get_page_table_entry(const page_dir_entry *page_dir, uint32_t addr);
+int page_mapped(const page_dir_entry *page_dir, uint32_t addr);
+void unmap_page(page_dir_entry *page_dir, uint32_t addr, struct tlb_batch *batch);
+void unmap_range(page_dir_entry *page_dir, uint32_t start, uint32_t end);
+void page_info(void);
+void *kmap(uint32_t p_addr);
+void kunmap(void *addr);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/fs.h"
+
+#define PAGE_CACHE_BUCKETS 64 // 页缓存哈希表的桶数量，必须是 2 的幂
+
+void page_cache_init(void);
+uint32_t page_cache_find(const file_struct *file, off_t offset, uint32_t start, uint32_t end);
+void page_cache_add(const file_struct *file, off_t offset, uint32_t start, uint32_t end, uint32_t p_addr);
+void page_cache_remove(uint32_t p_addr);
+void page_cache_info(void);
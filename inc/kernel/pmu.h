@@ -2,6 +2,74 @@
 
 #include "types.h"
 
+#define PMU_MAX_ORDER 11 // 伙伴系统的阶数上限，单次最多申请 2^10 页（4 MiB）
+#define PMU_WMARK_LOW 64   // 低端内存空闲页低于此值时唤醒后台回收
+#define PMU_WMARK_HIGH 128 // 后台回收到低端内存空闲页达到此值为止
+#define PMU_BATCH_SIZE 32  // 批量释放时积攒的页数
+
+// page_frame 的 flags 位定义
+#define PF_FREE 0x1 // 页是空闲块的首页
+#define PF_SLAB 0x2 // 页属于 slab
+#define PF_CACHED 0x4 // 页位于页缓存中，被多个进程以只读方式共享
+#define PF_KSM 0x8 // 页是合并后的相同匿名页，被多个映射以写时复制方式共享
+
+/**
+ * 物理页元数据，每个可分配的物理页对应一个
+ *
+ * 页空闲时 prev/next 链接伙伴系统的空闲链表
+ * 页属于 slab 时 prev/next 链接 slab 缓存的 slab 链表，slab 的信息保存在首页中
+ * 用户页在 fork 后由多个进程写时复制共享，mapcount 记录共享者的数量
+ * 页缓存中的只读文件页由运行同一程序的进程共享，同样使用 mapcount 计数
+ * 内容相同的匿名页合并后由各个映射写时复制共享，同样使用 mapcount 计数
+ */
+typedef struct page_frame
+{
+    struct page_frame *prev;       // 所在链表的前一个块
+    struct page_frame *next;       // 所在链表的后一个块
+    uint8_t order;                 // 块阶数，仅块首页有效
+    uint8_t flags;                 // PF_*
+    uint16_t inuse;                // slab 中已分配的对象数量
+    struct kmem_cache *slab_cache; // 所属 slab 缓存，slab 的每一页都会设置
+    union
+    {
+        void *freelist;                  // slab 中的空闲对象链表
+        struct cached_page *cache_entry; // 页缓存中对应的条目，仅 PF_CACHED 页有效
+        struct ksm_node *ksm_node;       // 合并页表中对应的条目，仅 PF_KSM 页有效
+    };
+    uint32_t mapcount;             // 除第一个映射外共享该页的映射数量，0 表示独占
+} page_frame;
+
+/**
+ * 待释放页的批次，积攒满后按地址排序，相邻的页合并为大块一次归还伙伴系统
+ */
+typedef struct pmu_batch
+{
+    uint32_t count;                 // 已积攒的页数
+    uint32_t addrs[PMU_BATCH_SIZE]; // 待释放页的地址
+} pmu_batch;
+
 void pmu_init(uint32_t addr, size_t count);
+void pmu_add_range(uint32_t addr, size_t count);
+void pmu_set_highmem(uint32_t addr);
 uint32_t pmu_alloc(void);
-void pmu_free(uint32_t addr);
\ No newline at end of file
+uint32_t pmu_alloc_zeroed(void);
+uint32_t pmu_alloc_user(void);
+uint32_t pmu_alloc_user_zeroed(void);
+int pmu_zero_pool_refill(void);
+void pmu_free(uint32_t addr);
+uint32_t pmu_alloc_pages(uint32_t order);
+void pmu_free_pages(uint32_t addr, uint32_t order);
+void pmu_batch_init(pmu_batch *batch);
+void pmu_batch_add(pmu_batch *batch, uint32_t addr);
+void pmu_batch_flush(pmu_batch *batch);
+uint32_t pmu_alloc_contiguous(size_t count);
+void pmu_free_contiguous(uint32_t addr, size_t count);
+size_t pmu_free_count(void);
+size_t pmu_lowmem_free_count(void);
+void pmu_page_get(uint32_t addr);
+void pmu_page_put(uint32_t addr);
+int pmu_page_shared(uint32_t addr);
+void pmu_info(void);
+page_frame *pmu_frame(uint32_t addr);
+uint32_t pmu_frame_addr(const page_frame *frame);
+page_frame *pmu_block_head(const page_frame *frame, uint32_t order);
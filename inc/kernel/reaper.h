@@ -0,0 +1,12 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/page.h"
+#include "kernel/vma.h"
+
+#define REAPER_QUEUE_SIZE 32 // 等待释放的地址空间数量上限，队列满时同步释放
+
+void reaper_init(void);
+void reaper_defer(page_dir_entry *page_dir, vm_map *vmas);
+size_t reaper_drain(void);
+void reaper_info(void);
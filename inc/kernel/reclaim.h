@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+
+/**
+ * 缓存收缩器
+ *
+ * 持有可丢弃内存的子系统注册收缩器，内存紧张时由回收按注册顺序调用
+ * 先注册代价低的缓存，它们会先被回收
+ */
+typedef struct shrinker
+{
+    const char *name;
+    size_t (*count)(void);     // 可以释放的页数
+    size_t (*scan)(size_t nr); // 释放最多 nr 页，返回实际释放的页数
+    uint32_t freed;            // 累计释放的页数
+    struct shrinker *next;
+} shrinker;
+
+void reclaim_init(void);
+void register_shrinker(shrinker *s);
+size_t shrink_caches(size_t count);
+size_t reclaim_pages(size_t count);
+void reclaim_wakeup(void);
+int oom_kill(void);
+void oom_check(void);
+void reclaim_info(void);
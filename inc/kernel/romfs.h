@@ -0,0 +1,73 @@
+#pragma once
+
+#include "types.h"
+
+/**
+ * romfs 只读文件系统镜像格式
+ *
+ * 镜像由宿主机工具 tools/mkromfs.c 生成，内核启动时整体读入连续的物理内存
+ * 文件查找通过哈希表探测完成，文件数据按页对齐连续存放，可直接映射使用
+ *
+ * 镜像布局：
+ * +--------------+-----------+-----------+----------+-------------------------+
+ * | romfs_header | 哈希表    | 条目表    | 路径字符串 | 文件数据（每个文件页对齐）|
+ * +--------------+-----------+-----------+----------+-------------------------+
+ *
+ * NOTE: 修改格式时需要同步修改 tools/mkromfs.c 中的定义
+ */
+
+#define ROMFS_MAGIC 0x53464F52U // 字符串 "ROFS" 的等价小端编码整数
+#define ROMFS_VERSION 1
+#define ROMFS_ALIGN 4096 // 文件数据对齐大小
+
+// 条目标志
+#define ROMFS_FLAG_LZ4 0x1 // 文件数据使用 LZ4 块格式压缩
+
+typedef struct romfs_header
+{
+    uint32_t magic;        // 必须等于 ROMFS_MAGIC
+    uint32_t version;      // 必须等于 ROMFS_VERSION
+    uint32_t image_size;   // 镜像总字节数
+    uint32_t entry_count;  // 文件条目数量
+    uint32_t hash_size;    // 哈希表槽位数量，必须是 2 的幂
+    uint32_t hash_offset;  // 哈希表偏移
+    uint32_t entry_offset; // 条目表偏移
+    uint32_t name_offset;  // 路径字符串表偏移
+} __attribute__((packed)) romfs_header;
+
+/**
+ * 文件条目
+ *
+ * 条目表按路径字典序排列
+ * 哈希表槽位保存“条目下标 + 1”，0 表示空槽位，冲突时线性探测下一个槽位
+ */
+typedef struct romfs_entry
+{
+    uint32_t hash;        // 路径的 FNV-1a 哈希值
+    uint32_t name_offset; // 路径在字符串表内的偏移（不含 '\0'）
+    uint32_t name_len;    // 路径长度
+    uint32_t flags;       // 条目标志
+    uint32_t data_offset; // 文件数据在镜像内的偏移，ROMFS_ALIGN 对齐
+    uint32_t size;        // 文件原始大小
+    uint32_t stored_size; // 文件数据在镜像内占用的大小（压缩后大小）
+    uint32_t reserved;
+} __attribute__((packed)) romfs_entry;
+
+/**
+ * 计算路径的 FNV-1a 哈希值
+ */
+static inline uint32_t romfs_hash(const char *path)
+{
+    uint32_t hash = 2166136261U;
+    while (*path)
+    {
+        hash ^= (uint8_t)*(path++);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+void romfs_init(void);
+const romfs_entry *romfs_find(const char *path);
+const void *romfs_file_data(const romfs_entry *entry);
+size_t romfs_read(void *dst, off_t offset, size_t size, const romfs_entry *entry);
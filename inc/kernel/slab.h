@@ -0,0 +1,52 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/pmu.h"
+
+#define SLAB_HWCACHE_ALIGN 0x1 // 对象按缓存行对齐，避免热点对象跨缓存行
+
+#define CACHE_LINE_SIZE 32 // i386/i486 的缓存行大小
+
+#define KMALLOC_MIN_SHIFT 3  // kmalloc 最小对象 8 字节
+#define KMALLOC_MAX_SHIFT 11 // kmalloc 最大对象 2 KiB，更大的申请直接使用伙伴系统
+
+/**
+ * slab 缓存，管理同一类型的对象
+ *
+ * 每个 slab 是 2^order 个连续物理页，切分为大小相同的对象
+ * slab 的空闲对象链表、已分配对象数等信息保存在首页的 page_frame 中
+ */
+typedef struct kmem_cache
+{
+    const char *name;
+    size_t object_size;     // 对象原始大小
+    size_t size;            // 对象实际占用大小（对齐后，包含空闲链表指针）
+    size_t align;           // 对象对齐
+    size_t offset;          // 空闲链表指针在对象内的偏移
+    uint32_t order;         // 每个 slab 的页阶数
+    uint32_t objs_per_slab; // 每个 slab 的对象数量
+    uint32_t flags;         // SLAB_*
+    void (*ctor)(void *obj);
+
+    page_frame *partial; // 部分分配的 slab 链表
+    page_frame *full;    // 全部分配的 slab 链表
+    page_frame *empty;   // 空闲 slab 链表
+
+    // 统计信息
+    uint32_t active_objs; // 已分配对象数量
+    uint32_t total_objs;  // 所有 slab 的对象数量
+    uint32_t nr_slabs;    // slab 数量
+    uint32_t nr_empty;    // 空闲 slab 数量
+    uint32_t allocs;      // 累计申请次数
+    uint32_t frees;       // 累计释放次数
+
+    struct kmem_cache *next; // 所有缓存组成的链表
+} kmem_cache;
+
+void slab_init(void);
+kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align, uint32_t flags, void (*ctor)(void *));
+void *kmem_cache_alloc(kmem_cache *cache);
+void kmem_cache_free(kmem_cache *cache, void *obj);
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+void slab_info(void);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/page.h"
+
+#define PART_TYPE_LINUX_SWAP 0x82 // MBR 分区类型 Linux swap，用作交换区
+#define SWAP_ENTRY_ZRAM (1U << 19) // 换出页表项地址字段的最高位，表示页保存在 zram 中，其余位为 zram 槽位号
+#define SWAP_MAX_SLOTS (1U << 19)  // 交换分区槽位数量上限，槽位号保存在页表项的 20 位地址字段中
+#define SWAP_CLUSTER 32           // 内存耗尽时每次回收的页数
+
+/**
+ * 检查页表项是否为换出页
+ *
+ * 换出页的页表项不存在，avl 字段带有 PTE_AVL_SWAP 标志，地址字段保存换出项（交换分区或 zram 的槽位号）
+ * 其余位（rw/us/写时复制标志）保持换出前的值，换入时恢复
+ */
+static inline int pte_swapped(const page_tabel_entry *pte)
+{
+    return !pte->present && (pte->avl & PTE_AVL_SWAP);
+}
+
+void swap_init(void);
+void swap_dup(uint32_t entry);
+void swap_free(uint32_t entry);
+uint32_t swap_reclaim(uint32_t count);
+int swap_fault(page_dir_entry *page_dir, uint32_t addr);
+void swap_info(void);
@@ -8,5 +8,14 @@
 #define SYS_NR_WAIT 5
 #define SYS_NR_WAITPID 6
 #define SYS_NR_EXECL 7
+#define SYS_NR_OPEN 8
+#define SYS_NR_READ 9
+#define SYS_NR_CLOSE 10
+#define SYS_NR_FADVISE 11
+#define SYS_NR_MADVISE 12
+#define SYS_NR_MEMINFO 13
+#define SYS_NR_YIELD 14
+#define SYS_NR_SPAWN 15
+#define SYS_NR_BRK 16
 
-#define NR_SYSCALL 8
\ No newline at end of file
+#define NR_SYSCALL 17
\ No newline at end of file
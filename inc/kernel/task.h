@@ -3,9 +3,14 @@
 #include "types.h"
 #include "kernel/page.h"
 #include "kernel/gdt.h"
+#include "kernel/file.h"
+#include "kernel/vma.h"
 
 #define NR_TASKS 100 // 最大任务数量
 #define INIT_PID 1 // 初始任务 PID
+#define USER_STACK_TOP 0xC0000000U // 用户栈顶地址，栈区域位于其下方，与程序段的地址相隔很远
+#define USER_STACK_SIZE (8 * 1024 * 1024) // 为栈保留的区域大小，也是任务栈大小的默认上限
+#define USER_HEAP_LIMIT (USER_STACK_TOP - USER_STACK_SIZE - STACK_GUARD_GAP) // 堆的结束地址上限，不能进入栈区域和保护空隙
 
 /**
  * 中断栈帧
@@ -44,11 +49,17 @@ typedef struct task_struct
     uint32_t exit_code;
     interrupt_frame *interrupt_frame;
     page_dir_entry *page_dir;
+    vm_map vmas;   // 用户地址空间中按需映射的区域
+    uint32_t brk_start; // 堆起始地址，位于程序段之后
+    uint32_t brk;       // 堆结束地址（program break）
+    uint32_t stack_limit; // 用户栈大小上限，不超过 USER_STACK_SIZE
+    uint32_t oom_killed;  // 内存耗尽时被选中结束，在系统调用返回或缺页处理失败时结束
     struct task_struct* prev;
     struct task_struct* next;
     struct task_struct* parent;
     struct task_struct* child;
     struct task_struct* sibling;
+    open_file *files[NR_OPEN]; // 文件描述符表，0~2 保留给标准输入输出
 } task_struct;
 
 typedef union task_union
@@ -58,7 +69,10 @@ typedef union task_union
 } task_union;
 
 task_struct* create_task_from_elf(const char *file_path, task_struct *parent);
+task_struct* create_kernel_task(void (*entry)(void));
 int reload_task_from_elf(const char *file_path, task_struct *task);
 task_struct* fork_task(task_struct *parent);
+task_struct* spawn_task(const char *file_path, task_struct *parent);
 void task_exit(task_struct *task, int exit_code);
-void task_dead(task_struct *task);
\ No newline at end of file
+void task_dead(task_struct *task);
+task_struct *task_at(uint32_t index);
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/page.h"
+
+#define TLB_FLUSH_THRESHOLD 32 // 超过这个页数时重新加载 CR3 清空整个 TLB，而不是逐页执行 invlpg
+
+/**
+ * 延迟的 TLB 刷新
+ *
+ * 逐页修改页表项的循环把需要失效的地址记录下来，结束后统一刷新
+ * 记录的页数超过 TLB_FLUSH_THRESHOLD 时不再记录，刷新时清空整个 TLB
+ */
+typedef struct tlb_batch
+{
+    const page_dir_entry *page_dir;      // 页表项所属的页目录
+    uint32_t count;                      // 记录的页数
+    uint32_t addrs[TLB_FLUSH_THRESHOLD]; // 需要失效的页地址
+} tlb_batch;
+
+void tlb_flush_all(void);
+void tlb_flush_page(const page_dir_entry *page_dir, uint32_t addr);
+void tlb_flush_range(const page_dir_entry *page_dir, uint32_t start, uint32_t end);
+void tlb_batch_init(tlb_batch *batch, const page_dir_entry *page_dir);
+void tlb_batch_add(tlb_batch *batch, uint32_t addr);
+void tlb_batch_flush(tlb_batch *batch);
+void tlb_info(void);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.h"
+#include "kernel/page.h"
+#include "kernel/file.h"
+
+// vm_area 的 flags 位定义
+#define VM_READ 0x1  // 可读
+#define VM_WRITE 0x2 // 可写
+#define VM_EXEC 0x4  // 可执行
+#define VM_GROWSDOWN 0x8 // 栈区域，访问下方的地址时向下扩展
+
+#define STACK_GUARD_GAP (256 * PAGE_SIZE) // 栈区域与下方区域之间至少保留的空隙
+
+/**
+ * 用户地址空间中的一段区域
+ *
+ * 区域内的页在首次访问时才由缺页异常分配并填充
+ * [file_start, file_end) 范围内的数据来自文件，其余部分（如 BSS）为 0
+ * 有文件的是文件区域，VM_GROWSDOWN 的是栈区域，其余是匿名区域（堆）
+ * 进程的所有区域按起始地址递增组成双向链表，同时组成以起始地址为键的 AVL 树
+ */
+typedef struct vm_area
+{
+    uint32_t start;        // 起始地址，页对齐
+    uint32_t end;          // 结束地址（不含），页对齐
+    uint32_t flags;        // VM_*
+    open_file *file;       // 映射的文件，NULL 表示匿名区域
+    off_t file_offset;     // file_start 对应的文件偏移
+    uint32_t file_start;   // 文件数据的起始地址
+    uint32_t file_end;     // 文件数据的结束地址（不含）
+    struct vm_area *prev;  // 地址更低的相邻区域
+    struct vm_area *next;  // 地址更高的相邻区域
+    struct vm_area *left;  // AVL 左子树
+    struct vm_area *right; // AVL 右子树
+    uint32_t height;       // 子树高度，叶子为 1
+} vm_area;
+
+/**
+ * 进程的地址空间区域
+ *
+ * 链表用于按地址顺序遍历，树用于按地址查找区域，是 O(log n)
+ */
+typedef struct vm_map
+{
+    vm_area *head; // 地址最低的区域
+    vm_area *root; // AVL 树根
+} vm_map;
+
+void vma_init(void);
+int vma_add(vm_map *map, uint32_t start, uint32_t end, uint32_t flags,
+            open_file *file, off_t file_offset, uint32_t file_start, uint32_t file_end);
+vm_area *vma_find(const vm_map *map, uint32_t addr);
+int vma_grow_stack(vm_map *map, uint32_t addr, uint32_t limit);
+int vma_fault(page_dir_entry *page_dir, const vm_map *map, uint32_t addr, int write);
+int vma_copy(vm_map *dst, const vm_map *src);
+void vma_free(vm_map *map);
+int vma_brk(page_dir_entry *page_dir, vm_map *map, uint32_t start, uint32_t old_end, uint32_t new_end);
+int vma_advise(page_dir_entry *page_dir, const vm_map *map, uint32_t addr, size_t len, int advice);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "types.h"
+
+void vmalloc_init(void);
+void *vmalloc(size_t size);
+void vfree(void *addr);
+int vmalloc_fault(uint32_t addr);
+void vmalloc_info(void);
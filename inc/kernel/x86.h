@@ -3,6 +3,12 @@
 #include "types.h"
 
 #define CR0_PG (1 << 31) // CR0 寄存器启用分页功能标志位
+#define CR0_WP (1 << 16) // CR0 寄存器写保护标志位，置位后内核写只读页也会触发缺页异常
+#define CR4_PSE (1 << 4) // CR4 寄存器启用 4 MiB 大页标志位
+#define CR4_PGE (1 << 7) // CR4 寄存器启用全局页标志位
+#define EFLAGS_IF (1 << 9) // EFLAGS 寄存器中断允许标志位
+#define EFLAGS_AC (1 << 18) // EFLAGS 寄存器对齐检查标志位，i386 上无法修改
+#define EFLAGS_ID (1 << 21) // EFLAGS 寄存器 CPUID 指令可用标志位，可修改则支持 CPUID
 
 __attribute__((always_inline))
 static inline uint8_t inb(uint16_t port)
@@ -80,6 +86,61 @@ static inline void set_cr3(uint32_t value)
     asm volatile("mov %0,%%cr3" : : "r"(value));
 }
 
+/**
+ * NOTE: i386/i486 没有 CR4 寄存器，调用前要通过 CPUID 确认支持相关功能
+ */
+__attribute__((always_inline))
+static inline uint32_t get_cr4(void)
+{
+    uint32_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+__attribute__((always_inline))
+static inline void set_cr4(uint32_t value)
+{
+    asm volatile("mov %0,%%cr4" : : "r"(value));
+}
+
+__attribute__((always_inline))
+static inline uint32_t get_cr2(void)
+{
+    uint32_t value;
+    asm volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+/**
+ * 清除线性地址所在页的 TLB 条目
+ *
+ * i486 起支持，cpu_init 已确认 CPU 不是 i386
+ */
+__attribute__((always_inline))
+static inline void invlpg(uint32_t addr)
+{
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+__attribute__((always_inline))
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile("cpuid"
+                 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                 : "a"(leaf), "c"(0));
+}
+
+/**
+ * 读取时间戳计数器的低 32 位
+ */
+__attribute__((always_inline))
+static inline uint32_t rdtsc(void)
+{
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return low;
+}
+
 __attribute__((always_inline))
 static inline void sti(void)
 {
@@ -110,4 +171,16 @@ static inline uint32_t get_eflags(void)
         : "cc"
     );
     return eflags;
+}
+
+__attribute__((always_inline))
+static inline void set_eflags(uint32_t eflags)
+{
+    asm volatile (
+        "push %0\n\t"
+        "popf"
+        :
+        : "r"(eflags)
+        : "cc", "memory"
+    );
 }
\ No newline at end of file
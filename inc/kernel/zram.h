@@ -0,0 +1,15 @@
+#pragma once
+
+#include "types.h"
+
+#define ZRAM_SLOTS 4096       // 压缩页槽位数量，最多保存 16 MiB 未压缩数据
+#define ZRAM_CLASS_SIZE 64    // 压缩数据块的大小类别粒度
+#define ZRAM_MAX_OBJ 2048     // 压缩后超过该大小的页每个内存池页只能放一个，视为不可压缩
+#define ZRAM_CLASSES (ZRAM_MAX_OBJ / ZRAM_CLASS_SIZE)
+
+void zram_init(void);
+uint32_t zram_store(uint32_t page_addr, int *adopted);
+int zram_load(uint32_t id, uint32_t page_addr);
+void zram_dup(uint32_t id);
+void zram_free(uint32_t id);
+void zram_info(void);
@@ -2,7 +2,9 @@
 
 #include "varg.h"
 
+#define STDIN 0
 #define STDOUT 1
+#define STDERR 2
 
 int sprintf(char *buf, const char *fmt, ...);
 int vsprintf(char *buf, const char *fmt, va_list args);
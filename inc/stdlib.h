@@ -0,0 +1,8 @@
+#pragma once
+
+#include "types.h"
+
+void *malloc(size_t size);
+void *calloc(size_t count, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
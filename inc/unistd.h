@@ -2,6 +2,7 @@
 
 #include "types.h"
 #include "waitflags.h"
+#include "advice.h"
 
 int syscall(int syscall_no, ...);
 int write(int fd, const void *buf, int count);
@@ -10,4 +11,14 @@ pid_t getpid(void);
 void exit(int status);
 pid_t wait(int *status);
 pid_t waitpid(pid_t pid, int *status, int options);
-int execl(const char *path, const char *arg0, ...);
\ No newline at end of file
+int execl(const char *path, const char *arg0, ...);
+pid_t spawnl(const char *path, const char *arg0, ...);
+int open(const char *path);
+int read(int fd, void *buf, int count);
+int close(int fd);
+int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+int madvise(void *addr, size_t len, int advice);
+int meminfo(void);
+int yield(void);
+int brk(void *addr);
+void *sbrk(int increment);
\ No newline at end of file
@@ -2,6 +2,13 @@
 #include "kernel/kernel.h"
 #include "kernel/ata.h"
 
+/**
+ * 是否有命令正在传输数据
+ *
+ * PIO 传输期间访问目标缓冲区缺页时，缺页处理不能再发起磁盘读写，否则会破坏当前命令
+ */
+static int transfer_in_progress = 0;
+
 /**
  * 等待 BSY 状态位更新
  *
@@ -131,6 +138,7 @@ int ata_read(void *dst, lba_t lba, uint16_t count)
      * LBA 48 的参数是 16 bit
      */
     outb(ATA_REG_COMMAND, ATA_CMD_READ_PIO_EXT);
+    transfer_in_progress = 1;
 
     // 循环读取每个扇区，使用 do-while 是为了让 count 为 0 时循环 65536 次
     do
@@ -138,12 +146,14 @@ int ata_read(void *dst, lba_t lba, uint16_t count)
         // 每个扇区读取前等待数据就绪
         if (ata_data_ready() < 0)
         {
+            transfer_in_progress = 0;
             return -1;
         }
         insl(ATA_REG_DATA, dst, SECT_SIZE / 4); // 将数据读取到当前缓冲区
         dst += SECT_SIZE;                       // 移动缓冲区指针
     } while (--count);
 
+    transfer_in_progress = 0;
     return 0;
 }
 
@@ -180,6 +190,7 @@ int ata_write(const void *src, lba_t lba, uint16_t count)
 
     // 发送写入命令
     outb(ATA_REG_COMMAND, ATA_CMD_WRITE_PIO_EXT);
+    transfer_in_progress = 1;
 
     // 循环写入每个扇区，使用 do-while 是为了让 count 为 0 时循环 65536 次
     do
@@ -187,11 +198,23 @@ int ata_write(const void *src, lba_t lba, uint16_t count)
         // 每个扇区写入前等待设备就绪
         if (ata_data_ready() < 0)
         {
+            transfer_in_progress = 0;
             return -1;
         }
         outsl(ATA_REG_DATA, src, SECT_SIZE / 4); // 将数据从当前缓冲区写入磁盘
         src += SECT_SIZE;                        // 移动缓冲区指针
     } while (--count);
 
+    transfer_in_progress = 0;
     return 0;
 }
+
+/**
+ * 是否有读写命令正在传输数据
+ *
+ * @return 1 正在传输，0 空闲
+ */
+int ata_busy(void)
+{
+    return transfer_in_progress;
+}
@@ -0,0 +1,72 @@
+#include "kernel/cpu.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+
+static uint32_t cpu_features = 0; // CPUID 1 号功能 EDX 寄存器的特性标志
+
+/**
+ * 检查 CPU 是否至少是 i486
+ *
+ * i386 没有 EFLAGS 的 AC 位，无法修改；CR0.AM 为 0 时修改 AC 位不会启用对齐检查
+ */
+static int i486_or_later(void)
+{
+    uint32_t eflags = get_eflags();
+    set_eflags(eflags ^ EFLAGS_AC);
+    uint32_t toggled = get_eflags();
+    set_eflags(eflags);
+    return ((toggled ^ eflags) & EFLAGS_AC) != 0;
+}
+
+/**
+ * 检查 CPU 是否支持 CPUID 指令
+ *
+ * i386 和早期 i486 不支持 CPUID，此时 EFLAGS 的 ID 位无法修改
+ */
+static int cpuid_supported(void)
+{
+    uint32_t eflags = get_eflags();
+    set_eflags(eflags ^ EFLAGS_ID);
+    uint32_t toggled = get_eflags();
+    set_eflags(eflags);
+    return ((toggled ^ eflags) & EFLAGS_ID) != 0;
+}
+
+/**
+ * 检查 CPU 是否支持指定特性
+ *
+ * @param feature CPU_FEATURE_*
+ * @return 1 支持，0 不支持
+ */
+int cpu_has_feature(uint32_t feature)
+{
+    return (cpu_features & feature) == feature;
+}
+
+void cpu_init(void)
+{
+    /**
+     * 内核依赖 i486 引入的功能：invlpg 指令使单页的 TLB 条目失效
+     * CR0.WP 使内核写入用户的写时复制页时触发缺页异常，i386 会忽略它而直接改写共享的页
+     */
+    if (!i486_or_later())
+    {
+        panic("i486 or later CPU required");
+    }
+
+    if (!cpuid_supported())
+    {
+        DEBUGK("cpuid not supported");
+        return;
+    }
+
+    uint32_t max_leaf, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    if (max_leaf >= 1)
+    {
+        uint32_t eax;
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        cpu_features = edx;
+    }
+    DEBUGK("cpu features: %p", cpu_features);
+}
@@ -0,0 +1,92 @@
+#include "kernel/page.h"
+#include "kernel/swap.h"
+#include "kernel/vmalloc.h"
+#include "kernel/ata.h"
+#include "kernel/reclaim.h"
+#include "kernel/task.h"
+#include "kernel/scheduler.h"
+#include "kernel/kernel.h"
+#include "kernel/x86.h"
+
+/**
+ * 缺页异常处理
+ *
+ * 程序段等按需映射区域内的页在首次访问时在此申请并填充
+ * 栈区域下方的访问在栈大小上限内时先向下扩展栈区域，再按需映射
+ * 已换出的页从交换区读回
+ * 写时复制页的写访问在此复制页面后返回，重新执行触发异常的指令
+ * 用户页目录缺少的 vmalloc 区域页目录项从内核页目录复制
+ * 其他对用户地址的非法访问结束当前任务，内核地址的非法访问无法恢复，直接停机
+ * 内存耗尽导致处理失败时，结束被 oom_kill 选中的当前任务
+ *
+ * @param error_code CPU 压入的错误码，PF_ERR_*
+ * @param eip 触发异常的指令地址
+ */
+void page_fault_handler(uint32_t error_code, uint32_t eip)
+{
+    // CR2 保存了触发异常的线性地址，处理过程中再次缺页会覆盖它，所以要先读取
+    uint32_t addr = get_cr2();
+    task_struct *task = running_task(0);
+
+    DEBUGK("page fault at %p, eip %p, error code %x", addr, eip, error_code);
+
+    // 内核访问 vmalloc 区域，而当前页目录创建时对应的页表还不存在
+    if (!(error_code & PF_ERR_PRESENT) && vmalloc_fault(addr) == 0)
+    {
+        return;
+    }
+
+    /**
+     * 以下处理可能读写磁盘：换入页、读取文件映射，或者申请内存时回收页并换出
+     * 内核在 PIO 传输途中缺页时发起新的磁盘命令会破坏当前传输，只能停机
+     * 读取磁盘的调用方要先把数据读到内核缓冲区，命令完成后再拷贝给用户，参考 open_file_read
+     */
+    if (!(error_code & PF_ERR_USER) && ata_busy())
+    {
+        panic("#PF at %p during disk transfer, eip %p, error code %x", addr, eip, error_code);
+    }
+
+    // 访问未映射的页，可能是已换出到交换区的页、按需映射区域内尚未访问的页，或者栈区域下方需要扩展栈的页
+    // 系统调用在磁盘传输之外访问用户的缓冲区时同样处理
+    if (!(error_code & PF_ERR_PRESENT) && task != NULL)
+    {
+        if (swap_fault(task->page_dir, addr) == 0)
+        {
+            return;
+        }
+        vma_grow_stack(&task->vmas, addr, task->stack_limit);
+        if (vma_fault(task->page_dir, &task->vmas, addr, (error_code & PF_ERR_WRITE) != 0) == 0)
+        {
+            return;
+        }
+    }
+
+    // 写只读页，可能是写时复制页
+    // 内核态写入用户页时同样处理，例如系统调用写用户的缓冲区
+    if ((error_code & PF_ERR_PRESENT) && (error_code & PF_ERR_WRITE) && task != NULL)
+    {
+        if (page_cow_fault(task->page_dir, addr) == 0)
+        {
+            return;
+        }
+    }
+
+    // 内核自身的地址出错无法恢复
+    // 系统调用访问非法的用户地址时，与用户态的非法访问一样结束当前任务
+    if (task == NULL || (!(error_code & PF_ERR_USER) && addr < KERNEL_SPACE_END))
+    {
+        panic("#PF at %p, eip %p, error code %x", addr, eip, error_code);
+    }
+
+    // 处理过程中申请内存失败，当前任务已被选中结束，不是非法访问
+    oom_check();
+
+    printk("task %d: segmentation fault at %p, eip %p\n", task->pid, addr, eip);
+
+    // 结束当前任务，与 exit 系统调用的处理相同
+    switch_task_state(task, TASK_ZOMBIE);
+    task_exit(task, -1);
+    schedule_handler(NULL);
+
+    panic("page_fault_handler: no task to switch");
+}
@@ -0,0 +1,339 @@
+#include "kernel/file.h"
+#include "kernel/kernel.h"
+#include "kernel/pmu.h"
+#include "kernel/page.h"
+#include "kernel/ata.h"
+#include "kernel/slab.h"
+#include "kernel/reclaim.h"
+#include "kernel/task.h"
+#include "kernel/scheduler.h"
+#include "advice.h"
+#include "algobase.h"
+#include "string.h"
+
+static kmem_cache *file_cache = NULL; // 打开文件的对象缓存
+static uint32_t nr_files = 0;         // 已打开的文件数量
+static uint32_t nr_ra_bufs = 0;       // 已申请的预读缓冲区数量
+
+/**
+ * 直接读取磁盘时使用的中转缓冲区
+ *
+ * ATA 以 PIO 方式把扇区数据直接写入目标内存，如果目标是用户缓冲区，传输中途可能缺页
+ * 缺页处理会换入页或读取文件映射，在当前命令没有完成时发起新的磁盘读写，两次传输的数据都会被破坏
+ * 所以先读取到中转缓冲区，命令完成后再拷贝给用户，拷贝时的缺页可以安全地读写磁盘
+ *
+ * 系统调用执行期间不会切换任务，缺页处理也不会调用 open_file_read，所以共用一个缓冲区即可
+ */
+static uint8_t bounce_buf[RA_PAGES_MAX * PAGE_SIZE];
+
+/**
+ * 获取文件当前访问模式下的预读窗口大小
+ *
+ * @return 预读字节数，0 表示不预读
+ */
+static size_t ra_window(const open_file *f)
+{
+    // romfs 文件已整体位于内存，预读没有意义
+    if (f->file.fs_type == FS_TYPE_ROMFS)
+    {
+        return 0;
+    }
+
+    switch (f->advice)
+    {
+    case POSIX_FADV_RANDOM:
+        return 0;
+    case POSIX_FADV_SEQUENTIAL:
+        return RA_PAGES_MAX * PAGE_SIZE;
+    default:
+        return PAGE_SIZE;
+    }
+}
+
+// 释放预读缓冲区
+static void ra_drop(open_file *f)
+{
+    if (f->ra_buf != NULL)
+    {
+        pmu_free_contiguous((uint32_t)f->ra_buf, RA_PAGES_MAX);
+        f->ra_buf = NULL;
+        nr_ra_bufs--;
+    }
+    f->ra_start = 0;
+    f->ra_len = 0;
+}
+
+/**
+ * 从 offset 所在扇区开始填充预读缓冲区
+ *
+ * @param size 预读字节数，不超过 RA_PAGES_MAX 页
+ * @return 0 成功，-1 无法申请缓冲区
+ */
+static int ra_fill(open_file *f, off_t offset, size_t size)
+{
+    assert(size <= RA_PAGES_MAX * PAGE_SIZE);
+
+    if (f->ra_buf == NULL)
+    {
+        f->ra_buf = (uint8_t *)pmu_alloc_contiguous(RA_PAGES_MAX);
+        if (f->ra_buf == NULL)
+        {
+            return -1;
+        }
+        nr_ra_bufs++;
+    }
+
+    // 从扇区边界开始读取，省去 file_read 对非对齐开头的额外处理
+    f->ra_start = ALIGN_DOWN(offset, SECT_SIZE);
+    f->ra_len = file_read(f->ra_buf, f->ra_start, size, &f->file);
+    return 0;
+}
+
+/**
+ * 打开文件的构造函数
+ *
+ * 文件关闭时会释放缓冲区并清空这些字段，所以对象放回缓存时仍保持构造后的状态
+ */
+static void open_file_ctor(void *obj)
+{
+    memset(obj, 0, sizeof(open_file));
+}
+
+/**
+ * 打开文件并分配打开文件表项
+ *
+ * @param path 文件绝对路径
+ * @return 表项指针，NULL 表示失败
+ */
+open_file *open_file_create(const char *path)
+{
+    if (nr_files >= NR_FILE)
+    {
+        DEBUGK("too many open files");
+        return NULL;
+    }
+
+    open_file *f = kmem_cache_alloc(file_cache);
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    if (file_open(path, &f->file) != 0)
+    {
+        kmem_cache_free(file_cache, f);
+        return NULL;
+    }
+
+    f->count = 1;
+    f->pos = 0;
+    f->advice = POSIX_FADV_NORMAL;
+    nr_files++;
+    return f;
+}
+
+// 增加表项引用计数
+void open_file_get(open_file *f)
+{
+    assert(f != NULL && f->count > 0);
+    f->count++;
+}
+
+// 减少表项引用计数，计数为 0 时关闭文件并释放缓存
+void open_file_put(open_file *f)
+{
+    assert(f != NULL && f->count > 0);
+    if (--f->count > 0)
+    {
+        return;
+    }
+    ra_drop(f);
+    file_close(&f->file);
+    kmem_cache_free(file_cache, f);
+    nr_files--;
+}
+
+/**
+ * 从文件当前位置读取数据
+ *
+ * 命中预读缓冲区时直接拷贝，否则按访问模式决定的窗口大小重新预读
+ * 不预读或者剩余数据不小于预读窗口时不经过预读缓冲区，分块读取到中转缓冲区后拷贝
+ * romfs 文件已位于内存，直接拷贝到目标缓冲区
+ *
+ * @return 实际读取的字节数
+ */
+int open_file_read(open_file *f, void *buf, size_t count)
+{
+    size_t size = file_size(&f->file);
+    if (f->pos >= size)
+    {
+        return 0;
+    }
+    count = MIN(count, size - f->pos);
+
+    size_t read_bytes = 0;
+    while (read_bytes < count)
+    {
+        size_t remain = count - read_bytes;
+
+        // 命中预读缓冲区
+        if (f->ra_len > 0 && f->pos >= f->ra_start && f->pos < f->ra_start + f->ra_len)
+        {
+            size_t read_size = MIN(remain, f->ra_start + f->ra_len - f->pos);
+            memcpy(buf + read_bytes, f->ra_buf + (f->pos - f->ra_start), read_size);
+            read_bytes += read_size;
+            f->pos += read_size;
+            continue;
+        }
+
+        size_t window = ra_window(f);
+        if (remain >= window || ra_fill(f, f->pos, window) != 0)
+        {
+            if (f->file.fs_type == FS_TYPE_ROMFS)
+            {
+                size_t read_size = file_read(buf + read_bytes, f->pos, remain, &f->file);
+                read_bytes += read_size;
+                f->pos += read_size;
+                break;
+            }
+
+            size_t chunk = MIN(remain, sizeof(bounce_buf));
+            size_t read_size = file_read(bounce_buf, f->pos, chunk, &f->file);
+            memcpy(buf + read_bytes, bounce_buf, read_size);
+            read_bytes += read_size;
+            f->pos += read_size;
+            if (read_size < chunk)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // 预读没有得到当前位置的数据，说明读取磁盘失败
+        if (f->pos >= f->ra_start + f->ra_len)
+        {
+            break;
+        }
+    }
+
+    return read_bytes;
+}
+
+/**
+ * 设置文件访问模式建议
+ *
+ * NORMAL/SEQUENTIAL 调整预读窗口
+ * RANDOM 关闭预读，并提前建立簇链缓存，使任意位置的读取都能直接定位
+ * WILLNEED 建立簇链缓存，并把 [offset, offset + len) 的开头部分读入预读缓冲区
+ * DONTNEED 丢弃与 [offset, offset + len) 重叠的预读数据，整个文件都不再需要时同时释放簇链缓存
+ *
+ * @param offset 范围起始位置，按有符号数解释，负数不合法
+ * @param len 范围长度，0 表示到文件末尾
+ * @return 0 成功，-1 建议或范围不合法
+ */
+int open_file_advise(open_file *f, off_t offset, size_t len, int advice)
+{
+    // off_t 是无符号数，用户传入的负偏移会变成很大的值，与 posix_fadvise 一样按 EINVAL 拒绝
+    if ((int32_t)offset < 0 || offset + len < offset)
+    {
+        return -1;
+    }
+
+    size_t size = file_size(&f->file);
+    off_t end = (len == 0 || len > size - MIN(offset, size)) ? size : offset + len;
+
+    switch (advice)
+    {
+    case POSIX_FADV_NORMAL:
+    case POSIX_FADV_SEQUENTIAL:
+        f->advice = advice;
+        return 0;
+
+    case POSIX_FADV_RANDOM:
+        f->advice = advice;
+        ra_drop(f);
+        file_cache_extents(&f->file);
+        return 0;
+
+    case POSIX_FADV_WILLNEED:
+        if (f->file.fs_type == FS_TYPE_ROMFS || offset >= end)
+        {
+            return 0;
+        }
+        file_cache_extents(&f->file);
+        // 读取范围从扇区边界开始，需要加上扇区内偏移
+        ra_fill(f, offset, MIN(end - ALIGN_DOWN(offset, SECT_SIZE), RA_PAGES_MAX * PAGE_SIZE));
+        return 0;
+
+    case POSIX_FADV_DONTNEED:
+        if (f->ra_len > 0 && offset < f->ra_start + f->ra_len && end > f->ra_start)
+        {
+            ra_drop(f);
+        }
+        if (offset == 0 && end == size)
+        {
+            ra_drop(f);
+            file_drop_extents(&f->file);
+        }
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+static size_t ra_shrink_count(void)
+{
+    return nr_ra_bufs * RA_PAGES_MAX;
+}
+
+// 文件是否在任务的文件描述符表中
+static int task_has_file(const task_struct *task, const open_file *f)
+{
+    for (int fd = 0; task != NULL && fd < NR_OPEN; fd++)
+    {
+        if (task->files[fd] == f)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 释放预读缓冲区，之后的读取重新从磁盘预读
+ *
+ * 预读缓冲区只由文件描述符上的读取使用，所以遍历所有任务的文件描述符表就能找到
+ * 当前任务可能正在从缓冲区拷贝到自己的缓冲区时缺页，进而触发回收，所以跳过当前任务打开的文件
+ */
+static size_t ra_shrink_scan(size_t nr)
+{
+    const task_struct *current = running_task(0);
+    size_t freed = 0;
+    for (uint32_t i = 0; i < NR_TASKS && freed < nr; i++)
+    {
+        task_struct *task = task_at(i);
+        for (int fd = 0; task != NULL && fd < NR_OPEN && freed < nr; fd++)
+        {
+            open_file *f = task->files[fd];
+            if (f != NULL && f->ra_buf != NULL && !task_has_file(current, f))
+            {
+                ra_drop(f);
+                freed += RA_PAGES_MAX;
+            }
+        }
+    }
+    return freed;
+}
+
+static shrinker ra_shrinker = {
+    .name = "readahead",
+    .count = ra_shrink_count,
+    .scan = ra_shrink_scan,
+};
+
+void file_init(void)
+{
+    file_cache = kmem_cache_create("open_file", sizeof(open_file), 0, SLAB_HWCACHE_ALIGN, open_file_ctor);
+    assert(file_cache != NULL);
+    register_shrinker(&ra_shrinker);
+}
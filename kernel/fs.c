@@ -3,6 +3,7 @@
 #include "kernel/mbr.h"
 #include "kernel/fat16.h"
 #include "kernel/kernel.h"
+#include "kernel/slab.h"
 #include "algobase.h"
 #include "string.h"
 
@@ -106,11 +107,19 @@ static int fat_name_cmp(const fat_dir_entry *entry, const char *name)
 static uint16_t fat_next_clus(uint16_t cluster)
 {
     static uint8_t buf[SECT_SIZE];
+    static lba_t buf_lba = 0; // buf 中缓存的 FAT 扇区，0 表示无效
 
     // FAT 表的有效起始簇号是 0 ，所以不需要减 2
     uint32_t byte_offset = cluster * 2;
+    lba_t lba = fat.fat_start_lba + byte_offset / SECT_SIZE;
 
-    ata_read(buf, fat.fat_start_lba + byte_offset / SECT_SIZE, 1);
+    // 一个 FAT 扇区包含 256 个表项，连续遍历簇链时大多落在同一扇区，不必重复读盘
+    // 内核不会修改 FAT 表，所以缓存不会失效
+    if (lba != buf_lba)
+    {
+        ata_read(buf, lba, 1);
+        buf_lba = lba;
+    }
     return *(uint16_t *)(buf + (byte_offset % SECT_SIZE));
 }
 
@@ -279,6 +288,8 @@ static int fat_find_entry(const char *path, fat_dir_entry *out_entry)
 /**
  * 打开文件
  *
+ * 优先在 romfs 中通过哈希表查找，未找到再遍历 FAT16 目录
+ *
  * @param path 文件绝对路径
  * @param out_file 保存文件信息
  * @return 0 成功，-1 失败
@@ -289,36 +300,156 @@ int file_open(const char *path, file_struct *out_file)
     {
         return -1;
     }
+
+    out_file->clus_map = NULL;
+    out_file->clus_map_len = 0;
+
+    const romfs_entry *entry = romfs_find(path);
+    if (entry != NULL)
+    {
+        out_file->fs_type = FS_TYPE_ROMFS;
+        out_file->romfs_entry = entry;
+        return 0;
+    }
+
+    out_file->fs_type = FS_TYPE_FAT16;
     return fat_find_entry(path, &out_file->fat_entry);
 }
 
+/**
+ * 关闭文件，释放文件缓存
+ */
+void file_close(file_struct *file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    file_drop_extents(file);
+}
+
+/**
+ * 获取文件大小
+ */
+size_t file_size(const file_struct *file)
+{
+    if (file->fs_type == FS_TYPE_ROMFS)
+    {
+        return file->romfs_entry->size;
+    }
+    return file->fat_entry.file_size;
+}
+
+/**
+ * 建立文件的簇链缓存
+ *
+ * 一次性遍历文件的整条簇链并记录每个簇的簇号
+ * 之后读取文件任意位置时直接查表，不需要再从首簇开始逐个查询 FAT 表
+ * romfs 文件已整体位于内存，不需要缓存
+ *
+ * @return 0 成功，-1 失败
+ */
+int file_cache_extents(file_struct *file)
+{
+    if (file->fs_type != FS_TYPE_FAT16 || file->clus_map != NULL)
+    {
+        return 0;
+    }
+
+    const size_t clus_size = fat.bpb.sec_per_clus * SECT_SIZE;
+    uint32_t clus_count = CEIL_DIV(file->fat_entry.file_size, clus_size);
+    if (clus_count == 0)
+    {
+        return 0;
+    }
+
+    uint16_t *clus_map = kmalloc(clus_count * sizeof(uint16_t));
+    if (clus_map == NULL)
+    {
+        return -1;
+    }
+
+    // 簇链提前结束时，剩余表项保持为 0（非法簇号），读取时会退回查询 FAT 表并报错
+    memset(clus_map, 0, clus_count * sizeof(uint16_t));
+    uint16_t clus = file->fat_entry.fst_clus;
+    for (uint32_t i = 0; i < clus_count && fat_check_clus(clus); i++)
+    {
+        clus_map[i] = clus;
+        clus = fat_next_clus(clus);
+    }
+
+    file->clus_map = clus_map;
+    file->clus_map_len = clus_count;
+    return 0;
+}
+
+/**
+ * 释放文件的簇链缓存
+ */
+void file_drop_extents(file_struct *file)
+{
+    if (file->clus_map == NULL)
+    {
+        return;
+    }
+    kfree(file->clus_map);
+    file->clus_map = NULL;
+    file->clus_map_len = 0;
+}
+
+/**
+ * 获取文件第 index 个簇的簇号
+ *
+ * 有簇链缓存时直接查表，否则从首簇开始遍历 FAT 表
+ */
+static uint16_t fat_file_clus(const file_struct *file, uint32_t index)
+{
+    if (index < file->clus_map_len && file->clus_map[index] != 0)
+    {
+        return file->clus_map[index];
+    }
+
+    uint16_t clus = file->fat_entry.fst_clus;
+    while (index-- > 0 && fat_check_clus(clus))
+    {
+        clus = fat_next_clus(clus);
+    }
+    return clus;
+}
+
+/**
+ * 获取文件第 index 个簇的簇号，cur_clus 为第 index - 1 个簇的簇号
+ */
+static inline uint16_t fat_file_next_clus(const file_struct *file, uint32_t index, uint16_t cur_clus)
+{
+    if (index < file->clus_map_len && file->clus_map[index] != 0)
+    {
+        return file->clus_map[index];
+    }
+    return fat_next_clus(cur_clus);
+}
+
 /**
  * 读取 FAT 文件存储的数据
  *
  * @param dst 数据保存位置
  * @param offset 偏移字节，必须是扇区大小的整数倍
  * @param size 读取字节数，必须是扇区大小的整数倍
- * @param entry 文件条目
+ * @param file 文件信息
  * @return 读取结果，0 成功，-1 失败
  */
-static int fat_read(void *dst, off_t offset, size_t size, const fat_dir_entry *entry)
+static int fat_read(void *dst, off_t offset, size_t size, const file_struct *file)
 {
     assert(offset % SECT_SIZE == 0);
     assert(size % SECT_SIZE == 0);
 
     size_t read_bytes = 0;
 
-    /**
-     * 找到 offset 所在的簇号
-     * 期间不断减小 offset 的值，将其转换为簇内偏移
-     */
+    // 找到 offset 所在的簇号，并将 offset 转换为簇内偏移
     const size_t clus_size = fat.bpb.sec_per_clus * SECT_SIZE;
-    uint16_t cur_clus = entry->fst_clus;
-    while (offset >= clus_size)
-    {
-        cur_clus = fat_next_clus(cur_clus);
-        offset -= clus_size;
-    }
+    uint32_t clus_index = offset / clus_size;
+    uint16_t cur_clus = fat_file_clus(file, clus_index);
+    offset %= clus_size;
 
     if (!fat_check_clus(cur_clus))
     {
@@ -339,7 +470,7 @@ static int fat_read(void *dst, off_t offset, size_t size, const fat_dir_entry *e
     while (size - read_bytes >= clus_size)
     {
         // 获取下一个簇号
-        cur_clus = fat_next_clus(cur_clus);
+        cur_clus = fat_file_next_clus(file, ++clus_index, cur_clus);
         if (!fat_check_clus(cur_clus))
         {
             DEBUGK("warning: failed to find cluster number");
@@ -358,7 +489,7 @@ static int fat_read(void *dst, off_t offset, size_t size, const fat_dir_entry *e
     // 读取结尾簇，仅读取前几个需要的扇区
     if (read_bytes < size)
     {
-        cur_clus = fat_next_clus(cur_clus);
+        cur_clus = fat_file_next_clus(file, ++clus_index, cur_clus);
         if (!fat_check_clus(cur_clus))
         {
             DEBUGK("warning: failed to find cluster number");
@@ -393,6 +524,11 @@ size_t file_read(void *dst, off_t offset, size_t size, file_struct *file)
         return 0;
     }
 
+    if (file->fs_type == FS_TYPE_ROMFS)
+    {
+        return romfs_read(dst, offset, size, file->romfs_entry);
+    }
+
     // 不能超过文件上限
     if (offset >= file->fat_entry.file_size)
     {
@@ -418,7 +554,7 @@ size_t file_read(void *dst, off_t offset, size_t size, file_struct *file)
         size_t read_size = MIN(size, SECT_SIZE - sec_off); // 该扇区内要读取的数据大小
 
         // 先读入临时缓冲区
-        if (0 > fat_read(buf, offset - sec_off, SECT_SIZE, &file->fat_entry))
+        if (0 > fat_read(buf, offset - sec_off, SECT_SIZE, file))
         {
             return read_bytes;
         }
@@ -433,7 +569,7 @@ size_t file_read(void *dst, off_t offset, size_t size, file_struct *file)
     {
         size_t read_size = ALIGN_DOWN(size - read_bytes, SECT_SIZE);
 
-        if (0 > fat_read(dst + read_bytes, offset + read_bytes, read_size, &file->fat_entry))
+        if (0 > fat_read(dst + read_bytes, offset + read_bytes, read_size, file))
         {
             return read_bytes;
         }
@@ -447,7 +583,7 @@ size_t file_read(void *dst, off_t offset, size_t size, file_struct *file)
         size_t read_size = size - read_bytes;
 
         // 先读入临时缓冲区
-        if (0 > fat_read(buf, offset + read_bytes, SECT_SIZE, &file->fat_entry))
+        if (0 > fat_read(buf, offset + read_bytes, SECT_SIZE, file))
         {
             return read_bytes;
         }
@@ -2,8 +2,18 @@
 #include "kernel/x86.h"
 
 void tty_init(void);
+void cpu_init(void);
 void mem_init(void);
+void slab_init(void);
+void vmalloc_init(void);
 void fs_init(void);
+void romfs_init(void);
+void file_init(void);
+void vma_init(void);
+void page_cache_init(void);
+void ksm_init(void);
+void zram_init(void);
+void swap_init(void);
 void idt_init(void);
 void pic_init(void);
 void syscall_init(void);
@@ -17,10 +27,20 @@ void init(void)
     pic_init();
     sti();
 
+    cpu_init();
     mem_init();
+    slab_init();
+    vmalloc_init();
     syscall_init();
 
     fs_init();
+    romfs_init();
+    file_init();
+    vma_init();
+    page_cache_init();
+    ksm_init();
+    zram_init();
+    swap_init();
 
     task_init();
 
@@ -75,11 +75,7 @@ __attribute__((naked)) void isr_gp(void)
 {
     panic("#GP");
 }
-// Page Fault
-__attribute__((naked)) void isr_pf(void)
-{
-    panic("#PF");
-}
+// Page Fault 由 entry.S 中的 isr_pf 处理
 // x87 Floating-Point Exception
 __attribute__((naked)) void isr_mf(void)
 {
@@ -0,0 +1,385 @@
+#include "kernel/ksm.h"
+#include "kernel/pmu.h"
+#include "kernel/slab.h"
+#include "kernel/task.h"
+#include "kernel/page.h"
+#include "kernel/tlb.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * 相同页合并（KSM）
+ *
+ * fork 出的大量进程中常有内容完全相同的私有页（清零的 BSS、相同的数据段），写时复制断开后各自占用一页
+ * 空闲任务在空闲时依次扫描所有任务的用户页表，把内容相同的独占匿名页合并为一页，以写时复制方式共享
+ * 写入合并页时由 page_cow_fault 复制出私有页，所以合并对进程是透明的
+ *
+ * 两张表用于查找内容相同的页，都以页内容的哈希值为键，哈希值相同时再逐字节比较：
+ * - 合并页表：已经合并的页，页的生命周期与页缓存相同，由 mapcount 管理
+ *   最后一个映射解除或写入前由 ksm_remove 将页移出合并页表
+ * - 候选页表：本轮扫描中见过但还没有找到相同页的独占页，只记录位置，每轮扫描开始时全部失效
+ *   候选页在之后可能被修改，所以使用前要重新检查映射并比较内容
+ * 候选页表是直接映射的，哈希冲突时新的页替换旧的页，只会错过少量合并机会
+ *
+ * 只合并原本可写的页（可写或写时复制），只读页合并后会在写时复制时错误地变为可写
+ * 被多个进程共享的页没有反向映射，无法修改所有页表项，不参与合并
+ * 页在扫描期间不会被修改（扫描时关闭中断），合并后立即写保护，所以不需要检查页内容是否稳定
+ */
+
+// 合并页表条目
+typedef struct ksm_node
+{
+    uint32_t hash;         // 页内容的哈希值
+    uint32_t p_addr;       // 合并页的物理地址
+    struct ksm_node *next; // 同一哈希桶中的下一个条目
+} ksm_node;
+
+// 候选页，pass 不是当前扫描轮次时无效
+typedef struct ksm_item
+{
+    uint32_t pass; // 记录时的扫描轮次
+    uint32_t hash; // 页内容的哈希值
+    uint32_t task; // 任务下标
+    pid_t pid;     // 任务 PID，用于检查任务槽位是否已被其他任务使用
+    uint32_t addr; // 页的线性地址
+} ksm_item;
+
+static kmem_cache *node_cache = NULL;                // 合并页表条目的对象缓存
+static ksm_node *buckets[KSM_BUCKETS] = {0};         // 合并页表
+static ksm_item unstable[KSM_UNSTABLE_SIZE] = {{0}}; // 候选页表
+
+// 扫描位置
+static struct
+{
+    uint32_t task; // 正在扫描的任务下标
+    uint32_t addr; // 下一个要扫描的线性地址，0 表示从用户空间开头开始
+    uint32_t pass; // 扫描轮次，从 1 开始，候选页表中的 0 表示无效
+} cursor = {0, 0, 1};
+
+// 统计信息
+static struct
+{
+    uint32_t pages;  // 合并页数量
+    uint32_t merges; // 合并到合并页的映射数量
+    uint32_t scans;  // 计算过哈希值的页数
+    uint32_t passes; // 完成的扫描轮数
+} stats = {0};
+
+static uint32_t page_hash(uint32_t p_addr)
+{
+    const uint32_t *words = kmap(p_addr);
+    uint32_t hash = 2166136261U;
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++)
+    {
+        hash = (hash ^ words[i]) * 16777619U;
+    }
+    kunmap((void *)words);
+    return hash;
+}
+
+static int page_same(uint32_t p_addr1, uint32_t p_addr2)
+{
+    void *page1 = kmap(p_addr1);
+    void *page2 = kmap(p_addr2);
+    int same = memcmp(page1, page2, PAGE_SIZE) == 0;
+    kunmap(page2);
+    kunmap(page1);
+    return same;
+}
+
+/**
+ * 检查页表项映射的页能否合并：原本可写的独占用户页，不在页缓存中，也不是合并页
+ */
+static int pte_mergeable(const page_tabel_entry *pte)
+{
+    if (!pte->present || !pte->us || (!pte->rw && !(pte->avl & PTE_AVL_COW)))
+    {
+        return 0;
+    }
+    uint32_t page_addr = pte->addr << 12;
+    return !pmu_page_shared(page_addr) && !(pmu_frame(page_addr)->flags & (PF_CACHED | PF_KSM));
+}
+
+static inline int scannable(const task_struct *task)
+{
+    // 跳过空位、已释放地址空间的僵尸进程和使用内核页目录的内核任务
+    return task != NULL && task->page_dir != NULL && task->page_dir != get_kernel_page_dir();
+}
+
+/**
+ * 将页表项改为只读的写时复制页
+ */
+static void write_protect(const task_struct *task, page_tabel_entry *pte, uint32_t addr)
+{
+    if (pte->rw)
+    {
+        pte->rw = 0;
+        pte->avl |= PTE_AVL_COW;
+        tlb_flush_page(task->page_dir, addr);
+    }
+}
+
+/**
+ * 将页表项改为映射合并页，释放原来的独占页
+ */
+static void merge_page(const task_struct *task, page_tabel_entry *pte, uint32_t addr, uint32_t ksm_addr)
+{
+    uint32_t page_addr = pte->addr << 12;
+    pmu_page_get(ksm_addr);
+    pte->addr = ksm_addr >> 12;
+    if (pte->rw)
+    {
+        pte->rw = 0;
+        pte->avl |= PTE_AVL_COW;
+    }
+    tlb_flush_page(task->page_dir, addr);
+    pmu_page_put(page_addr);
+    stats.merges++;
+}
+
+static ksm_node *stable_find(uint32_t hash, uint32_t page_addr)
+{
+    for (ksm_node *node = buckets[hash & (KSM_BUCKETS - 1)]; node != NULL; node = node->next)
+    {
+        if (node->hash == hash && page_same(node->p_addr, page_addr))
+        {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 将页加入合并页表
+ *
+ * @param node 调用者预先申请的条目
+ */
+static void stable_add(ksm_node *node, uint32_t hash, uint32_t page_addr)
+{
+    node->hash = hash;
+    node->p_addr = page_addr;
+
+    uint32_t index = hash & (KSM_BUCKETS - 1);
+    node->next = buckets[index];
+    buckets[index] = node;
+
+    page_frame *frame = pmu_frame(page_addr);
+    frame->flags |= PF_KSM;
+    frame->ksm_node = node;
+
+    stats.pages++;
+}
+
+/**
+ * 获取候选页当前的页表项
+ *
+ * @param task 输出，候选页所属的任务
+ * @return 页表项，NULL 表示任务已退出或页已不能合并
+ */
+static page_tabel_entry *item_pte(const ksm_item *item, task_struct **task)
+{
+    *task = task_at(item->task);
+    if (!scannable(*task) || (*task)->pid != item->pid)
+    {
+        return NULL;
+    }
+    page_tabel_entry *pte = get_page_table_entry((*task)->page_dir, item->addr);
+    return pte != NULL && pte_mergeable(pte) ? pte : NULL;
+}
+
+/**
+ * 为页查找内容相同的页并合并
+ *
+ * 先查找合并页表，再查找候选页表，候选页相同时成为新的合并页，都没有时将页记录为候选页
+ * 合并页表条目要在比较之前申请：申请可能进入内存回收，换出或丢弃正在比较的页，甚至结束任务释放整个地址空间
+ * 所以申请之后重新检查任务和两个页表项，比较和合并之间不再申请内存
+ *
+ * @return 0 继续扫描，-1 任务的地址空间在申请内存时被释放，页表已经无效
+ */
+static int scan_page(uint32_t index, task_struct *task, page_tabel_entry *pte, uint32_t addr)
+{
+    const page_dir_entry *page_dir = task->page_dir;
+    uint32_t page_addr = pte->addr << 12;
+    uint32_t hash = page_hash(page_addr);
+    stats.scans++;
+
+    ksm_node *node = stable_find(hash, page_addr);
+    if (node != NULL)
+    {
+        merge_page(task, pte, addr, node->p_addr);
+        return 0;
+    }
+
+    ksm_item *item = &unstable[hash & (KSM_UNSTABLE_SIZE - 1)];
+    if (item->pass == cursor.pass && item->hash == hash)
+    {
+        ksm_node *new_node = kmem_cache_alloc(node_cache);
+        if (task->page_dir != page_dir)
+        {
+            kmem_cache_free(node_cache, new_node);
+            return -1;
+        }
+
+        task_struct *other = NULL;
+        page_tabel_entry *other_pte = item_pte(item, &other);
+        if (new_node != NULL && pte_mergeable(pte) && (pte->addr << 12) == page_addr &&
+            other_pte != NULL && other_pte != pte)
+        {
+            uint32_t other_addr = other_pte->addr << 12;
+            if (page_same(other_addr, page_addr))
+            {
+                stable_add(new_node, hash, other_addr);
+                write_protect(other, other_pte, item->addr);
+                merge_page(task, pte, addr, other_addr);
+                item->pass = 0;
+                return 0;
+            }
+        }
+        kmem_cache_free(node_cache, new_node);
+    }
+
+    item->pass = cursor.pass;
+    item->hash = hash;
+    item->task = index;
+    item->pid = task->pid;
+    item->addr = addr;
+    return 0;
+}
+
+/**
+ * 从扫描位置继续扫描任务的用户页表
+ *
+ * 扫描到 count 页时停在下一页，扫描到地址空间末尾时扫描位置回到开头
+ *
+ * @return 扫描的页数
+ */
+static uint32_t scan_task(uint32_t index, task_struct *task, uint32_t count)
+{
+    uint32_t scanned = 0;
+    uint32_t start = MAX(cursor.addr, kernel_area_page_dir_end_index << 22);
+    for (uint32_t i = page_dir_index(start); i < 1024; i++)
+    {
+        const page_dir_entry *pde = &task->page_dir[i];
+        if (!pde->present || !pde->us)
+        {
+            continue;
+        }
+
+        page_tabel_entry *page_table = (page_tabel_entry *)(pde->addr << 12);
+        uint32_t j = i == page_dir_index(start) ? page_table_index(start) : 0;
+        for (; j < 1024; j++)
+        {
+            if (!pte_mergeable(&page_table[j]))
+            {
+                continue;
+            }
+            uint32_t addr = (i << 22) | (j << 12);
+            if (scan_page(index, task, &page_table[j], addr) != 0)
+            {
+                // 任务已结束，下次从下一个任务开始
+                cursor.addr = 0;
+                return scanned + 1;
+            }
+            if (++scanned == count)
+            {
+                // 地址空间最后一页之后回绕为 0，正好表示下次从开头开始
+                cursor.addr = addr + PAGE_SIZE;
+                return scanned;
+            }
+        }
+    }
+    cursor.addr = 0;
+    return scanned;
+}
+
+/**
+ * 扫描一批页并合并内容相同的页，由空闲任务调用
+ *
+ * 所有任务扫描完一遍后开始新的一轮，候选页表随之失效
+ * 调用者需要关闭中断，防止扫描期间页表和页内容被修改
+ *
+ * @param count 最多扫描的页数
+ * @return 1 本轮扫描尚未完成，0 刚好完成一轮扫描
+ */
+int ksm_scan(uint32_t count)
+{
+    while (count > 0)
+    {
+        if (cursor.task == NR_TASKS)
+        {
+            cursor.task = 0;
+            cursor.pass++;
+            stats.passes++;
+            return 0;
+        }
+
+        task_struct *task = task_at(cursor.task);
+        if (scannable(task))
+        {
+            count -= scan_task(cursor.task, task, count);
+        }
+        else
+        {
+            cursor.addr = 0;
+        }
+
+        if (cursor.addr == 0)
+        {
+            cursor.task++;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 将页移出合并页表，在页的最后一个映射解除或写入前调用
+ *
+ * 不是合并页时不做任何处理
+ */
+void ksm_remove(uint32_t p_addr)
+{
+    page_frame *frame = pmu_frame(p_addr);
+    if (!(frame->flags & PF_KSM))
+    {
+        return;
+    }
+
+    ksm_node *node = frame->ksm_node;
+    ksm_node **pos = &buckets[node->hash & (KSM_BUCKETS - 1)];
+    while (*pos != node)
+    {
+        pos = &(*pos)->next;
+    }
+    *pos = node->next;
+
+    frame->flags &= ~PF_KSM;
+    frame->ksm_node = NULL;
+    kmem_cache_free(node_cache, node);
+    stats.pages--;
+}
+
+/**
+ * 输出相同页合并的统计信息
+ *
+ * 合并页除第一个映射外的每个映射都节省了一页，即 mapcount 之和
+ */
+void ksm_info(void)
+{
+    uint32_t saved = 0;
+    for (uint32_t i = 0; i < KSM_BUCKETS; i++)
+    {
+        for (ksm_node *node = buckets[i]; node != NULL; node = node->next)
+        {
+            saved += pmu_frame(node->p_addr)->mapcount;
+        }
+    }
+    printk("ksm: %u merged pages, %u pages saved, %u merges, %u pages scanned, %u full scans\n",
+           stats.pages, saved, stats.merges, stats.scans, stats.passes);
+}
+
+void ksm_init(void)
+{
+    node_cache = kmem_cache_create("ksm_node", sizeof(ksm_node), 0, 0, NULL);
+    assert(node_cache != NULL);
+}
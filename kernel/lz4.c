@@ -0,0 +1,206 @@
+#include "kernel/lz4.h"
+
+#define LZ4_MIN_MATCH 4 // 最短匹配长度，序列中记录的匹配长度需要加上该值
+#define LZ4_MFLIMIT 12      // 最后一个匹配必须在数据结尾 12 字节之前开始
+#define LZ4_LAST_LITERALS 5 // 数据结尾 5 字节必须是字面量
+#define LZ4_HASH_BITS 10    // 压缩时查找匹配的哈希表大小
+#define LZ4_MAX_OFFSET 65535
+
+/**
+ * 读取 LZ4 的变长长度字段
+ *
+ * 长度字段为 15 时，后续每个字节都累加到长度上，直到遇见不等于 255 的字节
+ *
+ * @return 0 成功，-1 数据越界
+ */
+static int read_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t byte;
+    do
+    {
+        if (*ip >= iend)
+        {
+            return -1;
+        }
+        byte = *((*ip)++);
+        *len += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+/**
+ * 解压 LZ4 块格式（block format）数据
+ *
+ * 每个序列由 token、字面量和匹配组成：
+ * token 高 4 位为字面量长度，低 4 位为匹配长度（减去 LZ4_MIN_MATCH）
+ * 最后一个序列只包含字面量
+ *
+ * @param src 压缩数据
+ * @param src_size 压缩数据大小
+ * @param dst 解压数据保存位置
+ * @param dst_capacity 解压缓冲区大小
+ * @return 解压后的字节数，-1 表示数据损坏
+ */
+int lz4_decompress(const void *src, size_t src_size, void *dst, size_t dst_capacity)
+{
+    const uint8_t *ip = src, *iend = ip + src_size;
+    uint8_t *op = dst, *oend = op + dst_capacity;
+
+    while (ip < iend)
+    {
+        uint8_t token = *(ip++);
+
+        // 拷贝字面量
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && read_length(&ip, iend, &literal_len) < 0)
+        {
+            return -1;
+        }
+        if (literal_len > (size_t)(iend - ip) || literal_len > (size_t)(oend - op))
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < literal_len; i++)
+        {
+            *(op++) = *(ip++);
+        }
+
+        // 最后一个序列没有匹配部分
+        if (ip >= iend)
+        {
+            break;
+        }
+
+        // 读取匹配偏移（小端 16 位）
+        if (iend - ip < 2)
+        {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst))
+        {
+            return -1;
+        }
+
+        // 拷贝匹配数据，源与目标可能重叠，所以必须逐字节复制
+        size_t match_len = token & 0xF;
+        if (match_len == 15 && read_length(&ip, iend, &match_len) < 0)
+        {
+            return -1;
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > (size_t)(oend - op))
+        {
+            return -1;
+        }
+        const uint8_t *match = op - offset;
+        while (match_len--)
+        {
+            *(op++) = *(match++);
+        }
+    }
+
+    return op - (uint8_t *)dst;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    // x86 允许非对齐访问
+    return *(const uint32_t *)p;
+}
+
+// 写入 LZ4 变长长度字段的扩展部分
+static uint8_t *write_length(uint8_t *op, size_t len)
+{
+    while (len >= 255)
+    {
+        *(op++) = 255;
+        len -= 255;
+    }
+    *(op++) = (uint8_t)len;
+    return op;
+}
+
+// 写入一个序列，match_len 为 0 表示最后一个只有字面量的序列
+static uint8_t *write_sequence(uint8_t *op, const uint8_t *literal, size_t literal_len, size_t offset, size_t match_len)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t)((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15)
+    {
+        op = write_length(op, literal_len - 15);
+    }
+    for (size_t i = 0; i < literal_len; i++)
+    {
+        *(op++) = literal[i];
+    }
+
+    if (match_len == 0)
+    {
+        return op;
+    }
+
+    *(op++) = offset & 0xFF;
+    *(op++) = (offset >> 8) & 0xFF;
+    match_len -= LZ4_MIN_MATCH;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+    if (match_len >= 15)
+    {
+        op = write_length(op, match_len - 15);
+    }
+    return op;
+}
+
+/**
+ * LZ4 块格式压缩（贪心匹配），与 tools/mkromfs.c 中的压缩器输出格式相同
+ *
+ * 哈希表不在每次压缩前清空，其中残留的位置可能来自之前的数据
+ * 每个候选位置都会先确认位于当前位置之前并且内容相同，所以残留的位置只会让匹配失败，不会出错
+ *
+ * @param src 原始数据
+ * @param size 原始数据大小
+ * @param dst 压缩数据保存位置，大小至少为 LZ4_COMPRESS_BOUND(size)
+ * @return 压缩后的字节数
+ */
+size_t lz4_compress(const void *src, size_t size, void *dst)
+{
+    static uint32_t table[1 << LZ4_HASH_BITS];
+
+    const uint8_t *in = src;
+    uint8_t *op = dst;
+    size_t anchor = 0, ip = 0;
+
+    if (size > LZ4_MFLIMIT)
+    {
+        const size_t mflimit = size - LZ4_MFLIMIT;
+        const size_t matchlimit = size - LZ4_LAST_LITERALS;
+
+        while (ip < mflimit)
+        {
+            uint32_t seq = read32(in + ip);
+            uint32_t h = (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+            size_t ref = table[h];
+            table[h] = ip;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(in + ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            size_t len = LZ4_MIN_MATCH;
+            while (ip + len < matchlimit && in[ref + len] == in[ip + len])
+            {
+                len++;
+            }
+
+            op = write_sequence(op, in + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, in + anchor, size - anchor, 0, 0);
+    return op - (uint8_t *)dst;
+}
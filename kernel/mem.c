@@ -1,80 +1,110 @@
 #include "kernel/gdt.h"
 #include "kernel/page.h"
 #include "kernel/pmu.h"
+#include "kernel/pagecache.h"
+#include "kernel/ksm.h"
+#include "kernel/swap.h"
+#include "kernel/tlb.h"
 #include "kernel/kernel.h"
 #include "kernel/x86.h"
+#include "kernel/cpu.h"
 #include "boot/args.h"
 #include "string.h"
 #include "algobase.h"
 
 static page_dir_entry kernel_page_dir[1024] __attribute__((aligned(PAGE_SIZE))) = {0};
 uint32_t kernel_area_page_dir_end_index = __UINT32_MAX__; // 在此之前的页表为内核专用区域，用户页表也要映射这些页表
+static page_tabel_entry *kmap_table = NULL; // 临时映射窗口的页表，所有页目录共享
+static uint32_t kmap_next = 0;              // 下次开始查找空闲临时映射的位置
 
+// 内核恒等映射的统计信息
+static struct
+{
+    uint32_t large_pages; // 4 MiB 大页数量
+    uint32_t page_tables; // 4 KiB 页表数量
+    uint32_t cycles;      // 建立映射耗费的 TSC 周期数，不支持 TSC 时为 0
+    uint32_t global;      // 是否启用全局页
+} kernel_map_stats = {0};
+
+// BIOS E820 内存布局条目
+typedef struct e820_entry
+{
+    uint64_t addr; // 起始地址
+    uint64_t len;  // 长度
+    uint32_t type; // 类型，E820_USABLE 表示可用内存
+} __attribute__((packed)) e820_entry;
+
+// 可用物理内存范围，按起始地址递增排列，互不重叠也不相邻
+static struct
+{
+    uint32_t start;
+    uint32_t end;
+} mem_ranges[E820_MAX_ENTRIES];
+static uint32_t mem_range_count = 0;
+
+/**
+ * 获取内核页目录，内核任务使用
+ */
+page_dir_entry *get_kernel_page_dir(void)
+{
+    return kernel_page_dir;
+}
+
+/**
+ * 切换页目录
+ *
+ * 重新加载 CR3 会清空非全局页的 TLB 条目，页目录未改变时不需要重新加载
+ */
 void switch_page_dir(const page_dir_entry *page_dir)
 {
-    set_cr3((uint32_t)page_dir);
+    if (get_cr3() != (uint32_t)page_dir)
+    {
+        set_cr3((uint32_t)page_dir);
+    }
 }
 
 /**
- * 创建用户页表
+ * 获取线性地址对应的页表项
+ *
+ * @return 页表项，NULL 表示地址所在的页表不存在
  */
-page_dir_entry *create_user_page_dir(void)
+page_tabel_entry *get_page_table_entry(const page_dir_entry *page_dir, uint32_t addr)
 {
-    // 申请页内存
-    page_dir_entry *page_dir = (page_dir_entry *)pmu_alloc();
-    assert(page_dir != NULL);
-    memset(page_dir, 0, PAGE_SIZE);
-    // 复制内核区域页表
-    for(uint32_t i = 0; i < kernel_area_page_dir_end_index; i++)
+    const page_dir_entry *pde = &page_dir[page_dir_index(addr)];
+    if (!pde->present || pde->ps)
     {
-        page_dir[i] = kernel_page_dir[i];
+        return NULL;
     }
-    return page_dir;
+    return &((page_tabel_entry *)(pde->addr << 12))[page_table_index(addr)];
 }
 
 /**
- * 映射物理地址到线性地址
- * 
- * @return 映射后的线性地址，0 表示失败
+ * 创建用户页表
+ *
+ * @return 页目录，NULL 表示内存不足
  */
-uint32_t map_physical_page(page_dir_entry *page_dir, uint32_t phys_addr, uint8_t us, uint8_t rw)
+page_dir_entry *create_user_page_dir(void)
 {
-    assert(page_dir != NULL);
-    assert(phys_addr != 0);
-    for (uint32_t i = kernel_area_page_dir_end_index; i < 1024; i++)
+    // 申请已清零的页内存，用户区域的页目录项均为空
+    page_dir_entry *page_dir = (page_dir_entry *)pmu_alloc_zeroed();
+    if (page_dir == NULL)
     {
-        if (!page_dir[i].present)
-        {
-            uint32_t page_table_addr = pmu_alloc();
-            assert(page_table_addr != 0);
-            memset((void *)(page_table_addr), 0, PAGE_SIZE);
-            page_dir[i].addr = page_table_addr >> 12;
-            page_dir[i].present = 1;
-            page_dir[i].us = us;
-            page_dir[i].rw = 1; // 页目录始终读写，具体权限由页表控制
-        }
-        page_tabel_entry *page_table = (page_tabel_entry *)(page_dir[i].addr << 12);
-        for (uint32_t j = 0; j < 1024; j++)
-        {
-            if (!page_table[j].present)
-            {
-                page_table[j].addr = phys_addr >> 12;
-                page_table[j].present = 1;
-                page_table[j].us = us;
-                page_table[j].rw = rw;
-                // 返回对应的线性地址
-                return (i << 22) | (j << 12);
-            }
-        }
+        return NULL;
     }
-    panic("No free page table entry");
-    return 0;
+    // 复制内核区域页表
+    for(uint32_t i = 0; i < kernel_area_page_dir_end_index; i++)
+    {
+        page_dir[i] = kernel_page_dir[i];
+    }
+    return page_dir;
 }
 
 /**
  * 映射物理地址到指定线性地址
+ *
+ * 线性地址原本没有映射，CPU 不会缓存不存在的页表项，所以不需要刷新 TLB
  * 
- * @return 0 表示成功，-1 表示失败
+ * @return 0 表示成功，-1 表示无法申请页表，调用者仍持有 phys_addr
  */
 int map_physical_page_to_linear(page_dir_entry *page_dir, uint32_t phys_addr, uint32_t linear_addr, uint8_t us, uint8_t rw)
 {
@@ -92,9 +122,11 @@ int map_physical_page_to_linear(page_dir_entry *page_dir, uint32_t phys_addr, ui
 
     if (!page_dir[pd_index].present)
     {
-        uint32_t page_table_addr = pmu_alloc();
-        assert(page_table_addr != 0);
-        memset((void *)(page_table_addr), 0, PAGE_SIZE);
+        uint32_t page_table_addr = pmu_alloc_zeroed();
+        if (page_table_addr == 0)
+        {
+            return -1;
+        }
         page_dir[pd_index].addr = page_table_addr >> 12;
         page_dir[pd_index].present = 1;
         page_dir[pd_index].us = us;
@@ -115,17 +147,19 @@ int map_physical_page_to_linear(page_dir_entry *page_dir, uint32_t phys_addr, ui
 }
 
 /**
- * 复制页目录和映射的内存数据
+ * 复制页目录，以写时复制的方式共享映射的内存
+ *
+ * 只复制用户区域的页表，物理页由父子进程共享，并增加页的共享计数
+ * 原本可写的页在双方的页表中都改为只读并标记 PTE_AVL_COW，首次写入时触发缺页异常再复制
+ * 所以 fork 不复制任何页面数据，耗时和内存占用与父进程的内存大小无关
+ * 父进程中改为只读的页批量刷新 TLB，可写页不多时不需要清空整个 TLB
+ *
+ * @return 0 成功，-1 内存不足，此时子进程页目录只包含已复制的页表，可以直接释放
  */
 int copy_page_dir_and_memory(page_dir_entry *dst_page_dir, const page_dir_entry *src_page_dir)
 {
-    // 保存当前页目录，切换到内核页目录
-    page_dir_entry *stashed_user_page_dir = NULL;
-    if (get_cr3() != (uint32_t)kernel_page_dir)
-    {
-        stashed_user_page_dir = (page_dir_entry *)get_cr3();
-        switch_page_dir(kernel_page_dir);
-    }
+    tlb_batch batch;
+    tlb_batch_init(&batch, src_page_dir);
 
     memcpy(dst_page_dir, src_page_dir, PAGE_SIZE);
     for (uint32_t i = kernel_area_page_dir_end_index; i < 1024; i++)
@@ -141,50 +175,140 @@ int copy_page_dir_and_memory(page_dir_entry *dst_page_dir, const page_dir_entry
         if (dst_page_table == NULL)
         {
             DEBUGK("Failed to alloc page table");
+            // 尚未复制的页目录项仍指向父进程的页表，清除后调用者才能用 free_user_page_dir 释放子进程
+            memset(&dst_page_dir[i], 0, (1024 - i) * sizeof(page_dir_entry));
+            tlb_batch_flush(&batch);
             return -1;
         }
-        memcpy(dst_page_table, src_page_table, PAGE_SIZE);
         dst_page_dir[i].addr = (uint32_t)dst_page_table >> 12;
 
         for (uint32_t j = 0; j < 1024; j++)
         {
+            // 换出页由父子进程共享同一个交换槽位
+            if (pte_swapped(&src_page_table[j]))
+            {
+                swap_dup(src_page_table[j].addr);
+                continue;
+            }
             if (!src_page_table[j].present)
             {
                 continue;
             }
 
-            // 复制页面
-            uint32_t src_page_addr = src_page_table->addr << 12;
-            uint32_t dst_page_addr = pmu_alloc();
-            if (dst_page_addr == 0)
+            // 共享页面，可写页改为只读的写时复制页
+            if (src_page_table[j].rw)
             {
-                DEBUGK("Failed to alloc page");
-                return -1;
+                src_page_table[j].rw = 0;
+                src_page_table[j].avl |= PTE_AVL_COW;
+                tlb_batch_add(&batch, (i << 22) | (j << 12));
             }
-            memcpy((void *)dst_page_addr, (void *)src_page_addr, PAGE_SIZE);
-            dst_page_table[j].addr = dst_page_addr >> 12;
+            pmu_page_get(src_page_table[j].addr << 12);
         }
+        memcpy(dst_page_table, src_page_table, PAGE_SIZE);
+    }
+
+    tlb_batch_flush(&batch);
+    return 0;
+}
+
+/**
+ * 处理写时复制页的写访问缺页异常
+ *
+ * 页仍被其他进程共享时复制一份再映射为可写，已经独占时直接恢复可写
+ *
+ * @param addr 触发异常的线性地址
+ * @return 0 处理成功，-1 不是写时复制页或者内存不足
+ */
+int page_cow_fault(page_dir_entry *page_dir, uint32_t addr)
+{
+    assert(page_dir != NULL);
+
+    if (page_dir_index(addr) < kernel_area_page_dir_end_index)
+    {
+        return -1;
     }
 
-    // 恢复页目录
-    if (stashed_user_page_dir != NULL)
+    page_tabel_entry *pte = get_page_table_entry(page_dir, addr);
+    if (pte == NULL || !pte->present || !(pte->avl & PTE_AVL_COW))
     {
-        switch_page_dir(stashed_user_page_dir);
+        return -1;
+    }
+
+    uint32_t page_addr = pte->addr << 12;
+    if (pmu_page_shared(page_addr))
+    {
+        uint32_t new_page_addr = pmu_alloc_user();
+        if (new_page_addr == 0)
+        {
+            return -1;
+        }
+        void *dst = kmap(new_page_addr);
+        void *src = kmap(page_addr);
+        memcpy(dst, src, PAGE_SIZE);
+        kunmap(src);
+        kunmap(dst);
+        pmu_page_put(page_addr);
+        pte->addr = new_page_addr >> 12;
     }
+    else
+    {
+        // 合并页只剩这一个映射，写入前移出合并页表，之后作为私有页使用
+        ksm_remove(page_addr);
+    }
+    pte->avl &= ~PTE_AVL_COW;
+    pte->rw = 1;
+
+    tlb_flush_page(page_dir, addr);
     return 0;
 }
 
+/**
+ * 解除用户页的一个映射，最后一个映射解除时将页移出页缓存或合并页表并回收
+ *
+ * @param batch 回收页的批次，NULL 表示立即回收
+ */
+static void user_page_put(uint32_t addr, pmu_batch *batch)
+{
+    if (pmu_page_shared(addr))
+    {
+        pmu_page_put(addr);
+        return;
+    }
+    page_cache_remove(addr);
+    ksm_remove(addr);
+    if (batch != NULL)
+    {
+        pmu_batch_add(batch, addr);
+    }
+    else
+    {
+        pmu_page_put(addr);
+    }
+}
+
+/**
+ * 释放尚未映射的用户页，用于映射失败时撤销 vma_fill_page 取得的页
+ */
+void release_user_page(uint32_t addr)
+{
+    user_page_put(addr, NULL);
+}
+
 void free_user_page_dir(page_dir_entry *page_dir)
 {
     assert(page_dir != NULL);
     assert(page_dir != kernel_page_dir);
 
-    // 如果释放的是当前使用的页目录，则先切换到内核页目录
+    // 如果释放的是当前使用的页目录，则先切换到内核页目录，TLB 中不会再留有其中的条目
     if (get_cr3() == (uint32_t)page_dir)
     {
         switch_page_dir(kernel_page_dir);
     }
 
+    // 回收的页和页表积攒成批释放
+    pmu_batch batch;
+    pmu_batch_init(&batch);
+
     // 遍历页目录条目
     for (uint32_t i = kernel_area_page_dir_end_index; i < 1024; i++)
     {
@@ -198,52 +322,263 @@ void free_user_page_dir(page_dir_entry *page_dir)
                 // 找到用户的内存页
                 if (page_table[j].present && page_dir[i].us)
                 {
-                    // 回收页内存
-                    pmu_free(page_table[j].addr << 12);
+                    // 解除映射，页不再被其他进程共享时回收
+                    user_page_put(page_table[j].addr << 12, &batch);
+                }
+                else if (pte_swapped(&page_table[j]))
+                {
+                    swap_free(page_table[j].addr);
                 }
             }
             // 回收页表
-            pmu_free((uint32_t)page_table);
+            pmu_batch_add(&batch, (uint32_t)page_table);
         }
     }
 
     // 回收页目录
-    pmu_free((uint32_t)page_dir);
+    pmu_batch_add(&batch, (uint32_t)page_dir);
+    pmu_batch_flush(&batch);
 }
 
-static size_t detect_memory(void)
+/**
+ * 检查用户线性地址是否已映射，已换出到交换区的页也视为已映射
+ */
+int page_mapped(const page_dir_entry *page_dir, uint32_t addr)
 {
-    /**
-     * 通过 MC146818 RTC 芯片的端口获取内存大小
-     * 以下端口是获取地址在 16 MiB 以上的扩展内存大小
-     * 数值单位为 64 KiB
-     */
-    uint32_t low, hi, total;
-    outb(0x70, 0x34);
-    low = inb(0x71);
-    outb(0x70, 0x35);
-    hi = inb(0x71);
-    total = low | (hi << 8);
-
-    // 内存需要大于 16 MiB
-    assert(total != 0);
-
-    // 返回总内存大小（字节）
-    return total * 64 * 1024 + (16U << 20);
+    const page_tabel_entry *pte = get_page_table_entry(page_dir, addr);
+    return pte != NULL && (pte->present || pte_swapped(pte));
+}
+
+/**
+ * 清除用户线性地址所在页的页表项，调用者负责刷新 TLB
+ *
+ * @return 1 清除了存在的页表项，需要刷新 TLB，0 不需要
+ */
+static int unmap_pte(page_dir_entry *page_dir, uint32_t addr)
+{
+    assert(page_dir_index(addr) >= kernel_area_page_dir_end_index);
+
+    page_tabel_entry *pte = get_page_table_entry(page_dir, addr);
+    if (pte != NULL && pte_swapped(pte))
+    {
+        swap_free(pte->addr);
+        memset(pte, 0, sizeof(page_tabel_entry));
+        return 0;
+    }
+    if (pte == NULL || !pte->present)
+    {
+        return 0;
+    }
+    user_page_put(pte->addr << 12, NULL);
+    memset(pte, 0, sizeof(page_tabel_entry));
+    return 1;
+}
+
+/**
+ * 解除用户线性地址所在页的映射，页不再被共享时回收，已换出的页释放交换槽位
+ *
+ * @param batch 记录需要失效的 TLB 条目，调用者之后统一刷新，NULL 表示立即刷新
+ */
+void unmap_page(page_dir_entry *page_dir, uint32_t addr, tlb_batch *batch)
+{
+    if (!unmap_pte(page_dir, addr))
+    {
+        return;
+    }
+    if (batch != NULL)
+    {
+        tlb_batch_add(batch, addr);
+    }
+    else
+    {
+        tlb_flush_page(page_dir, addr);
+    }
+}
+
+/**
+ * 解除 [start, end) 范围内所有页的映射，最后一次性刷新 TLB
+ *
+ * @param start 起始地址，页对齐
+ * @param end 结束地址（不含），页对齐
+ */
+void unmap_range(page_dir_entry *page_dir, uint32_t start, uint32_t end)
+{
+    int mapped = 0;
+    for (uint32_t page = start; page < end; page += PAGE_SIZE)
+    {
+        mapped |= unmap_pte(page_dir, page);
+    }
+    if (mapped)
+    {
+        tlb_flush_range(page_dir, start, end);
+    }
+}
+
+/**
+ * 输出内核恒等映射的统计信息
+ */
+void page_info(void)
+{
+    printk("kernel map: %u large pages, %u page tables, %u cycles, global pages %s\n",
+           kernel_map_stats.large_pages, kernel_map_stats.page_tables, kernel_map_stats.cycles,
+           kernel_map_stats.global ? "on" : "off");
+    printk("usable memory:");
+    for (uint32_t i = 0; i < mem_range_count; i++)
+    {
+        printk(" [%p, %p)", mem_ranges[i].start, mem_ranges[i].end);
+    }
+    printk("\n");
+}
+
+/**
+ * 记录可用内存范围，截断到 4 GiB 以内并向内按页对齐
+ *
+ * 部分 BIOS 返回的条目无序或者互相重叠，所以插入时保持有序，并合并重叠或相邻的范围
+ */
+static void add_mem_range(uint64_t start, uint64_t end)
+{
+    end = MIN(end, PHYS_MEM_END);
+    if (start >= end)
+    {
+        return;
+    }
+    uint32_t s = ALIGN_UP((uint32_t)start, PAGE_SIZE);
+    uint32_t e = ALIGN_DOWN((uint32_t)end, PAGE_SIZE);
+    if (s >= e)
+    {
+        return;
+    }
+
+    // [i, j) 是与新范围重叠或相邻的范围，合并为一个
+    uint32_t i = 0;
+    while (i < mem_range_count && mem_ranges[i].end < s)
+    {
+        i++;
+    }
+    uint32_t j = i;
+    while (j < mem_range_count && mem_ranges[j].start <= e)
+    {
+        s = MIN(s, mem_ranges[j].start);
+        e = MAX(e, mem_ranges[j].end);
+        j++;
+    }
+
+    if (i == j)
+    {
+        // 每个条目最多新增一个范围，所以不会超出数组
+        assert(mem_range_count < E820_MAX_ENTRIES);
+        for (uint32_t k = mem_range_count; k > i; k--)
+        {
+            mem_ranges[k] = mem_ranges[k - 1];
+        }
+        mem_range_count++;
+    }
+    else
+    {
+        for (uint32_t k = j; k < mem_range_count; k++)
+        {
+            mem_ranges[k - (j - i) + 1] = mem_ranges[k];
+        }
+        mem_range_count -= j - i - 1;
+    }
+    mem_ranges[i].start = s;
+    mem_ranges[i].end = e;
+}
+
+/**
+ * 检查 [start, end) 是否完整地位于某个可用范围内
+ */
+static int mem_range_contains(uint32_t start, uint32_t end)
+{
+    for (uint32_t i = 0; i < mem_range_count; i++)
+    {
+        if (mem_ranges[i].start <= start && end <= mem_ranges[i].end)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 检测可用的物理内存
+ *
+ * 优先使用 setup 通过 BIOS E820 获取的内存布局，记录其中所有的可用范围，跳过保留区域和空洞
+ * BIOS 不支持 E820 时退回到读取 CMOS，只能得到 16 MiB 以上扩展内存的大小，并假设 1 MiB ~ 16 MiB 可用
+ *
+ * @return 最高可用内存地址，不超过 PHYS_MEM_END
+ */
+static uint32_t detect_memory(void)
+{
+    uint32_t count = *(uint32_t *)P_E820_COUNT;
+    const e820_entry *map = (const e820_entry *)P_E820_MAP;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DEBUGK("e820: %p+%p type %u", (uint32_t)map[i].addr, (uint32_t)map[i].len, map[i].type);
+        if (map[i].type == E820_USABLE)
+        {
+            add_mem_range(map[i].addr, map[i].addr + map[i].len);
+        }
+    }
+
+    if (mem_range_count == 0)
+    {
+        /**
+         * 通过 MC146818 RTC 芯片的端口获取内存大小
+         * 以下端口是获取地址在 16 MiB 以上的扩展内存大小
+         * 数值单位为 64 KiB
+         */
+        uint32_t low, hi, total;
+        outb(0x70, 0x34);
+        low = inb(0x71);
+        outb(0x70, 0x35);
+        hi = inb(0x71);
+        total = low | (hi << 8);
+
+        // 内存需要大于 16 MiB
+        assert(total != 0);
+        add_mem_range(1U << 20, (uint64_t)total * 64 * 1024 + (16U << 20));
+    }
+
+    return mem_ranges[mem_range_count - 1].end;
 }
 
 /**
  * 初始化内核页表
  * 
- * 创建页目录和页表映射整个内存空间，便于内核管理内存
+ * 创建页目录和页表恒等映射整个低端内存，便于内核管理内存
+ * CPU 支持 PSE 时，完整的 4 MiB 区域使用大页直接由页目录项映射，不需要页表，也只占用一个 TLB 条目
+ * 不足 4 MiB 的末尾部分和不支持 PSE 时使用 4 KiB 页表映射
+ * 内核映射在所有页目录中都相同，所以标记为全局页，启用 PGE 后切换 CR3 时这些 TLB 条目不会被清空
+ *
+ * @return 创建的页表数量
  */
-static void kernel_page_init(size_t mem_size)
+static uint32_t kernel_page_init(size_t mem_size)
 {
     // 初始化页目录
     memset(kernel_page_dir, 0, PAGE_SIZE);
 
-    // 创建所有内存地址的页表映射
-    for (uint32_t addr = 0; addr < mem_size; addr += PAGE_SIZE)
+    uint32_t addr = 0;
+    if (cpu_has_feature(CPU_FEATURE_PSE))
+    {
+        // 启用 4 MiB 大页
+        set_cr4(get_cr4() | CR4_PSE);
+        for (; addr + LARGE_PAGE_SIZE <= mem_size; addr += LARGE_PAGE_SIZE)
+        {
+            size_t pd_index = page_dir_index(addr);
+            kernel_page_dir[pd_index].addr = addr >> 12;
+            kernel_page_dir[pd_index].present = 1;
+            kernel_page_dir[pd_index].us = 0;
+            kernel_page_dir[pd_index].rw = 1;
+            kernel_page_dir[pd_index].ps = 1;
+            kernel_page_dir[pd_index].global = 1;
+            kernel_map_stats.large_pages++;
+        }
+    }
+
+    // 创建剩余内存地址的页表映射
+    uint32_t page_tables = 0;
+    for (; addr < mem_size; addr += PAGE_SIZE)
     {
         // 计算地址对应的页目录下标
         size_t pd_index = page_dir_index(addr);
@@ -259,6 +594,7 @@ static void kernel_page_init(size_t mem_size)
             kernel_page_dir[pd_index].us = 0;
             kernel_page_dir[pd_index].rw = 1;
             kernel_page_dir[pd_index].ps = 0;
+            page_tables++;
         }
         // 找到页表
         page_tabel_entry *page_table = (page_tabel_entry *)(kernel_page_dir[pd_index].addr << 12);
@@ -269,7 +605,73 @@ static void kernel_page_init(size_t mem_size)
         page_table[pt_index].present = 1;
         page_table[pt_index].us = 0;
         page_table[pt_index].rw = 1;
+        page_table[pt_index].global = 1;
     }
+
+    /**
+     * 创建临时映射窗口的页表，之后创建的用户页目录都共享这个页表
+     * 临时映射随时变化，不是全局页，切换页目录时会从 TLB 中清除
+     */
+    kmap_table = (page_tabel_entry *)pmu_alloc_zeroed();
+    assert(kmap_table != NULL);
+    size_t pd_index = page_dir_index(KMAP_BASE);
+    kernel_page_dir[pd_index].addr = (uint32_t)kmap_table >> 12;
+    kernel_page_dir[pd_index].present = 1;
+    kernel_page_dir[pd_index].us = 0;
+    kernel_page_dir[pd_index].rw = 1;
+    kernel_page_dir[pd_index].ps = 0;
+    page_tables++;
+
+    return page_tables;
+}
+
+/**
+ * 建立物理页的临时内核映射
+ *
+ * 低端内存已经恒等映射，直接返回物理地址
+ * 高端内存的页映射到临时映射窗口中的空闲位置，使用后要调用 kunmap 解除
+ * 映射位置轮流使用，解除映射后不会马上被复用
+ *
+ * @return 内核可以访问的线性地址
+ */
+void *kmap(uint32_t p_addr)
+{
+    if (p_addr < LOWMEM_END)
+    {
+        return (void *)p_addr;
+    }
+
+    for (uint32_t n = 0; n < KMAP_SLOTS; n++)
+    {
+        uint32_t i = (kmap_next + n) % KMAP_SLOTS;
+        if (!kmap_table[i].present)
+        {
+            kmap_table[i].addr = p_addr >> 12;
+            kmap_table[i].present = 1;
+            kmap_table[i].rw = 1;
+            kmap_table[i].us = 0;
+            kmap_next = (i + 1) % KMAP_SLOTS;
+            return (void *)(KMAP_BASE + i * PAGE_SIZE);
+        }
+    }
+    panic("No free kmap slot");
+    return NULL;
+}
+
+/**
+ * 解除 kmap 建立的临时映射，恒等映射的地址不做任何处理
+ */
+void kunmap(void *addr)
+{
+    uint32_t linear_addr = ALIGN_DOWN((uint32_t)addr, PAGE_SIZE);
+    if (linear_addr < KMAP_BASE)
+    {
+        return;
+    }
+
+    memset(&kmap_table[page_table_index(linear_addr)], 0, sizeof(page_tabel_entry));
+    // 临时映射窗口在所有页目录中共享，无论当前是哪个页目录都要失效
+    invlpg(linear_addr);
 }
 
 /**
@@ -280,7 +682,20 @@ static void page_enable(void)
     // 将页目录地址加载到 CR3 寄存器
     set_cr3((uint32_t)kernel_page_dir);
     // 设置 CR0 的 PG 位启用分页功能
-    set_cr0(get_cr0() | CR0_PG);
+    // 同时设置 WP 位，使内核写入用户的写时复制页时也触发缺页异常，不会修改到共享的页，i486 起支持
+    set_cr0(get_cr0() | CR0_PG | CR0_WP);
+
+    /**
+     * 启用全局页，需要在启用分页之后设置
+     * 使用 -DNO_PGE 编译时不启用，用于对比任务切换的开销
+     */
+#ifndef NO_PGE
+    if (cpu_has_feature(CPU_FEATURE_PGE))
+    {
+        set_cr4(get_cr4() | CR4_PGE);
+        kernel_map_stats.global = 1;
+    }
+#endif
 }
 
 /**
@@ -288,24 +703,44 @@ static void page_enable(void)
  */
 static void page_init(size_t mem_size)
 {
-    uint32_t kernel_addr_end = *(uint32_t *)P_KERNEL_ADDR_END;
-    kernel_area_page_dir_end_index = page_dir_index(kernel_addr_end) + !!page_table_index(kernel_addr_end);
-    kernel_page_init(mem_size);
+    /**
+     * 页分配器可能返回任意位置的物理页，内核在用户页目录下也要能访问这些页
+     * 所以用户页目录要共享整个内核空间的页表，而不仅仅是内核程序所在的区域
+     */
+    kernel_area_page_dir_end_index = page_dir_index(KERNEL_SPACE_END);
+
+    // 记录建立内核页表的耗时，用于比较大页和 4 KiB 页表的启动开销
+    uint32_t start = cpu_has_feature(CPU_FEATURE_TSC) ? rdtsc() : 0;
+    kernel_map_stats.page_tables = kernel_page_init(mem_size);
+    kernel_map_stats.cycles = cpu_has_feature(CPU_FEATURE_TSC) ? rdtsc() - start : 0;
+
     page_enable();
 }
 
 void mem_init(void)
 {
-    // 检测内存大小
+    // 检测可用内存
     size_t mem_size = detect_memory();
     DEBUGK("mem_size: %u MiB", mem_size >> 20);
 
-    // 添加内核空间以上的内存到空闲页面记录
+    /**
+     * 页管理器管理内核之后到最高可用地址的范围，只有其中的可用范围会加入空闲链表
+     * 元数据位于范围开头，必须与内核位于同一个可用范围内
+     * 1 MiB 以下的内存保留给 BIOS 数据、启动参数和空指针页，不加入页管理器
+     * LOWMEM_END 以上的内存无法恒等映射，作为高端内存只分配给用户页和 vmalloc
+     */
     uint32_t kernel_addr_end = *(uint32_t *)P_KERNEL_ADDR_END;
     uint32_t addr = ALIGN_UP(kernel_addr_end, PAGE_SIZE); // 地址进行 4 KiB 对齐
     assert(addr < mem_size);
-    pmu_init(addr, (mem_size - addr) / PAGE_SIZE);
+    size_t count = (mem_size - addr) / PAGE_SIZE;
+    assert(mem_range_contains(addr, addr + CEIL_DIV(count * sizeof(page_frame), PAGE_SIZE) * PAGE_SIZE));
+    pmu_init(addr, count);
+    pmu_set_highmem(LOWMEM_END);
+    for (uint32_t i = 0; i < mem_range_count; i++)
+    {
+        pmu_add_range(mem_ranges[i].start, (mem_ranges[i].end - mem_ranges[i].start) / PAGE_SIZE);
+    }
 
     // 初始化内核分页
-    page_init(mem_size);
+    page_init(MIN(mem_size, LOWMEM_END));
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "kernel/pagecache.h"
+#include "kernel/pmu.h"
+#include "kernel/slab.h"
+#include "kernel/page.h"
+#include "kernel/kernel.h"
+
+/**
+ * 只读文件页缓存
+ *
+ * 程序的只读段（代码、只读数据）在运行同一程序的所有进程中内容相同
+ * 首个进程访问时读取文件填充的页加入缓存，之后其他进程访问同一位置时直接映射缓存中的页
+ * 所以同一程序的多个进程只保留一份只读段，启动新进程时也不需要再读取文件
+ *
+ * 页的生命周期由物理页的 mapcount 管理，缓存本身不持有引用
+ * 最后一个映射解除时由 page_cache_remove 将页移出缓存，随后页被释放
+ *
+ * 缓存条目以（文件，数据的文件偏移，页内数据范围）为键
+ * 页内不属于文件的部分为 0，所以这三者相同的页内容一定相同
+ */
+
+typedef struct cached_page
+{
+    uint8_t fs_type;          // 文件所在的文件系统类型
+    uint32_t file_id;         // 文件在文件系统内的标识
+    off_t offset;             // 页内文件数据起始处的文件偏移
+    uint16_t start;           // 文件数据在页内的起始偏移
+    uint16_t end;             // 文件数据在页内的结束偏移（不含）
+    uint32_t p_addr;          // 页的物理地址
+    struct cached_page *next; // 同一哈希桶中的下一个条目
+} cached_page;
+
+static kmem_cache *entry_cache = NULL;                 // 缓存条目的对象缓存
+static cached_page *buckets[PAGE_CACHE_BUCKETS] = {0}; // 哈希表
+
+// 统计信息
+static struct
+{
+    uint32_t pages;  // 缓存中的页数
+    uint32_t hits;   // 映射缓存中已有页的次数
+    uint32_t misses; // 读取文件并加入缓存的次数
+} stats = {0};
+
+/**
+ * 获取文件在文件系统内的唯一标识
+ *
+ * romfs 文件使用条目地址，FAT16 文件使用首簇号
+ */
+static uint32_t file_id(const file_struct *file)
+{
+    if (file->fs_type == FS_TYPE_ROMFS)
+    {
+        return (uint32_t)file->romfs_entry;
+    }
+    return file->fat_entry.fst_clus;
+}
+
+static inline uint32_t bucket_index(uint32_t id, off_t offset)
+{
+    return ((id * 2654435761U) ^ (offset / PAGE_SIZE)) & (PAGE_CACHE_BUCKETS - 1);
+}
+
+/**
+ * 查找缓存的文件页，找到时增加一个映射
+ *
+ * @param offset 页内文件数据起始处的文件偏移
+ * @param start 文件数据在页内的起始偏移
+ * @param end 文件数据在页内的结束偏移（不含）
+ * @return 页的物理地址，0 表示不在缓存中
+ */
+uint32_t page_cache_find(const file_struct *file, off_t offset, uint32_t start, uint32_t end)
+{
+    uint32_t id = file_id(file);
+    for (cached_page *entry = buckets[bucket_index(id, offset)]; entry != NULL; entry = entry->next)
+    {
+        if (entry->file_id == id && entry->fs_type == file->fs_type && entry->offset == offset &&
+            entry->start == start && entry->end == end)
+        {
+            pmu_page_get(entry->p_addr);
+            stats.hits++;
+            return entry->p_addr;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 将刚从文件填充的页加入缓存
+ *
+ * 调用者对页的映射成为页的第一个映射，页加入缓存后不能再被写入
+ * 内存不足时不加入缓存，页仍然作为调用者的私有页正常使用
+ */
+void page_cache_add(const file_struct *file, off_t offset, uint32_t start, uint32_t end, uint32_t p_addr)
+{
+    cached_page *entry = kmem_cache_alloc(entry_cache);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    entry->fs_type = file->fs_type;
+    entry->file_id = file_id(file);
+    entry->offset = offset;
+    entry->start = start;
+    entry->end = end;
+    entry->p_addr = p_addr;
+
+    uint32_t index = bucket_index(entry->file_id, offset);
+    entry->next = buckets[index];
+    buckets[index] = entry;
+
+    page_frame *frame = pmu_frame(p_addr);
+    frame->flags |= PF_CACHED;
+    frame->cache_entry = entry;
+
+    stats.pages++;
+    stats.misses++;
+}
+
+/**
+ * 将页移出缓存，在页的最后一个映射解除前调用
+ *
+ * 不在缓存中的页不做任何处理
+ */
+void page_cache_remove(uint32_t p_addr)
+{
+    page_frame *frame = pmu_frame(p_addr);
+    if (!(frame->flags & PF_CACHED))
+    {
+        return;
+    }
+
+    cached_page *entry = frame->cache_entry;
+    cached_page **pos = &buckets[bucket_index(entry->file_id, entry->offset)];
+    while (*pos != entry)
+    {
+        pos = &(*pos)->next;
+    }
+    *pos = entry->next;
+
+    frame->flags &= ~PF_CACHED;
+    frame->cache_entry = NULL;
+    kmem_cache_free(entry_cache, entry);
+    stats.pages--;
+}
+
+/**
+ * 输出页缓存的统计信息
+ */
+void page_cache_info(void)
+{
+    printk("page cache: %u pages, %u hits, %u misses\n", stats.pages, stats.hits, stats.misses);
+}
+
+void page_cache_init(void)
+{
+    entry_cache = kmem_cache_create("cached_page", sizeof(cached_page), 0, 0, NULL);
+    assert(entry_cache != NULL);
+}
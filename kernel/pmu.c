@@ -1,170 +1,424 @@
 #include "kernel/pmu.h"
 #include "kernel/page.h"
+#include "kernel/swap.h"
+#include "kernel/reclaim.h"
 #include "kernel/kernel.h"
-#include "kernel/x86.h"
 #include "string.h"
+#include "algobase.h"
 
-#define NODE_COUNT 1024 // 链表节点缓冲区大小
+/**
+ * 物理内存页管理器（伙伴系统）
+ *
+ * 每个物理页对应一个 page_frame 元数据，所有元数据组成数组，存放在可用内存的开头
+ * 空闲内存按 2^order 页的块管理，同阶的空闲块组成双向链表
+ * 申请时从足够大的块中拆分，释放时与相邻的同阶空闲块（伙伴）合并
+ * 块的伙伴下标为 index ^ (1 << order)，所以申请和释放都只需要 O(log n) 步
+ *
+ * 元数据数组覆盖从首个可分配页到最高可用地址的整个范围，其中可能有 BIOS 保留的空洞
+ * 空洞中的页始终处于已分配状态，永远不会释放，所以也不会与相邻的空闲块合并
+ *
+ * 内核只恒等映射低端内存，更高地址的页属于高端内存区域，两个区域分别维护空闲链表，块不会跨越区域边界
+ * 内核自己使用的页（页表、slab、缓冲区）只从低端内存申请，用户页和 vmalloc 的页优先从高端内存申请
+ * 内核访问高端内存的页时要先通过 kmap 建立临时映射
+ *
+ * 低端内存的空闲页低于 PMU_WMARK_LOW 时唤醒后台回收，耗尽时同步回收，仍然不够时结束一个任务释放内存
+ */
 
-typedef struct page_node
-{
-    uint32_t addr;
-    size_t count;
-    struct page_node *next;
-} page_node;
+#define ZERO_POOL_MAX 64 // 预清零页池的容量
 
-static page_node node_buf[NODE_COUNT];             // 链表节点缓冲区
-static uint8_t bitmap[(NODE_COUNT + 7) / 8] = {0}; // 位图初始化为全 0
+#define ZONE_NORMAL 0 // 低端内存区域，内核可以直接访问
+#define ZONE_HIGH 1   // 高端内存区域，内核需要临时映射才能访问
+#define NR_ZONES 2
 
 static struct
 {
+    uint32_t base;                          // 首个可分配页的地址
+    size_t total;                           // 元数据覆盖的页数量，包括空洞
+    size_t usable;                          // 可用页数量，不包括空洞
+    size_t high_usable;                     // 高端内存中的可用页数量
+    size_t count;                           // 空闲页数量
+    size_t high_index;                      // 高端内存首页的下标，等于 total 时没有高端内存
+    size_t zone_count[NR_ZONES];            // 各区域空闲页数量
+    page_frame *frames;                     // 页元数据数组
+    page_frame *free_list[NR_ZONES][PMU_MAX_ORDER]; // 各区域各阶空闲链表
+    size_t free_blocks[NR_ZONES][PMU_MAX_ORDER];    // 各区域各阶空闲块数量
+} pmu = {0};
+
+/**
+ * 预清零页池
+ *
+ * 空闲任务在 CPU 空闲时提前将页清零放入池中，pmu_alloc_zeroed 优先从池中取页
+ * 池中的页在伙伴系统中属于已分配状态，通过 page_frame 的 next 指针串联，不会写入页内容
+ */
+static struct
+{
+    page_frame *head;
     size_t count;
-    page_node *head;
-} pmu = {.count = 0, .head = NULL};
+    uint32_t hits;    // 从池中取到页的次数
+    uint32_t misses;  // 池为空、同步清零的次数
+    uint32_t refills; // 后台清零的页数
+} zero_pool = {0};
 
-// 检查位图中的某一位是否为 1
-static inline int is_bit_set(int index)
+static inline size_t frame_index(const page_frame *frame)
 {
-    return (bitmap[index / 8] >> (index % 8)) & 1;
+    return frame - pmu.frames;
 }
 
-// 设置位图中的某一位为 1
-static inline void set_bit(int index)
+static inline uint32_t frame_addr(const page_frame *frame)
 {
-    bitmap[index / 8] |= (1 << (index % 8));
+    return pmu.base + frame_index(frame) * PAGE_SIZE;
 }
 
-// 清除位图中的某一位（设为 0）
-static inline void clear_bit(int index)
+// 获取地址对应的页元数据
+static inline page_frame *addr_frame(uint32_t addr)
 {
-    bitmap[index / 8] &= ~(1 << (index % 8));
+    assert((addr & 0xFFF) == 0);
+    assert(addr >= pmu.base && (addr - pmu.base) / PAGE_SIZE < pmu.total);
+    return &pmu.frames[(addr - pmu.base) / PAGE_SIZE];
 }
 
-// 从缓冲区获取空闲链表节点并初始化
-static page_node *alloc_node(uint32_t addr, size_t count)
+/**
+ * 获取页地址对应的页元数据
+ *
+ * @param addr 页地址，可以不对齐
+ */
+page_frame *pmu_frame(uint32_t addr)
 {
-    for (int i = 0; i < NODE_COUNT; i++)
+    return addr_frame(ALIGN_DOWN(addr, PAGE_SIZE));
+}
+
+/**
+ * 获取页元数据对应的页地址
+ */
+uint32_t pmu_frame_addr(const page_frame *frame)
+{
+    return frame_addr(frame);
+}
+
+/**
+ * 获取页所在的 2^order 页块的首页元数据
+ *
+ * 伙伴系统分配的块相对于首个可分配页按块大小对齐，所以只需要清除下标的低位
+ */
+page_frame *pmu_block_head(const page_frame *frame, uint32_t order)
+{
+    return &pmu.frames[frame_index(frame) & ~((1U << order) - 1)];
+}
+
+static inline uint32_t index_zone(size_t index)
+{
+    return index >= pmu.high_index ? ZONE_HIGH : ZONE_NORMAL;
+}
+
+// 将空闲块加入所属区域对应阶的链表头部
+static void free_list_add(page_frame *frame, uint32_t order)
+{
+    uint32_t zone = index_zone(frame_index(frame));
+    frame->order = order;
+    frame->flags |= PF_FREE;
+    frame->prev = NULL;
+    frame->next = pmu.free_list[zone][order];
+    if (frame->next != NULL)
     {
-        if (!is_bit_set(i))
-        {
-            set_bit(i);
-            node_buf[i].addr = addr;
-            node_buf[i].count = count;
-            node_buf[i].next = NULL;
-            return node_buf + i;
-        }
+        frame->next->prev = frame;
     }
-    panic("page node buffer exhausted");
-    return NULL;
+    pmu.free_list[zone][order] = frame;
+    pmu.free_blocks[zone][order]++;
 }
 
-// 释放链表节点
-static void free_node(page_node *node)
+// 将空闲块从对应阶的链表中删除
+static void free_list_del(page_frame *frame)
 {
-    // 判断节点是否属于 node_buf
-    assert(node >= node_buf);
-    assert(node <= node_buf + NODE_COUNT - 1);
-
-    clear_bit(node - node_buf);
-    node->count = 0;
-    node->addr = 0;
-    node->next = NULL;
+    uint32_t order = frame->order;
+    if (frame->prev != NULL)
+    {
+        frame->prev->next = frame->next;
+    }
+    else
+    {
+        pmu.free_list[index_zone(frame_index(frame))][order] = frame->next;
+    }
+    if (frame->next != NULL)
+    {
+        frame->next->prev = frame->prev;
+    }
+    frame->prev = frame->next = NULL;
+    frame->flags &= ~PF_FREE;
+    pmu.free_blocks[index_zone(frame_index(frame))][order]--;
 }
 
-// 添加空闲页记录
-static void pmu_add_record(uint32_t addr, size_t count)
+/**
+ * 释放 2^order 页的块，并与伙伴逐级合并
+ *
+ * @param index 块首页下标，必须按 2^order 对齐
+ */
+static void buddy_free(size_t index, uint32_t order)
 {
-    DEBUGK("Add page free record: addr = %p, count = %u", addr, count);
+    assert((index & ((1U << order) - 1)) == 0);
+    assert(!(pmu.frames[index].flags & PF_FREE));
 
-    assert(count != 0);          // 数量不得为 0
-    assert(addr != 0);           // 地址不得为 0
-    assert((addr & 0xFFF) == 0); // 地址 4 KiB 对齐
+    pmu.count += 1U << order;
+    pmu.zone_count[index_zone(index)] += 1U << order;
 
-    pmu.count += count;
+    while (order < PMU_MAX_ORDER - 1)
+    {
+        size_t buddy = index ^ (1U << order);
+        // 伙伴必须完整存在，是同阶的空闲块，并且与块位于同一区域
+        if (buddy + (1U << order) > pmu.total || index_zone(buddy) != index_zone(index) ||
+            !(pmu.frames[buddy].flags & PF_FREE) ||
+            pmu.frames[buddy].order != order)
+        {
+            break;
+        }
+        free_list_del(&pmu.frames[buddy]);
+        index &= ~(1U << order);
+        order++;
+    }
 
-    if (pmu.head == NULL)
+    free_list_add(&pmu.frames[index], order);
+}
+
+/**
+ * 从区域中申请 2^order 页的块
+ *
+ * @return 块首页元数据，NULL 表示失败
+ */
+static page_frame *buddy_alloc_zone(uint32_t zone, uint32_t order)
+{
+    // 找到不小于 order 的最小非空阶
+    uint32_t cur = order;
+    while (cur < PMU_MAX_ORDER && pmu.free_list[zone][cur] == NULL)
     {
-        pmu.head = alloc_node(addr, count);
-        return;
+        cur++;
+    }
+    if (cur == PMU_MAX_ORDER)
+    {
+        return NULL;
     }
 
-    // 找到插位置的前/后节点，第一个地址比 addr 大的节点为后置节点
-    page_node *p = NULL, *p_pre = NULL, *p_next = pmu.head;
-    while (p_next != NULL && addr > p_next->addr)
+    page_frame *frame = pmu.free_list[zone][cur];
+    free_list_del(frame);
+
+    // 逐级对半拆分，后一半作为空闲块放回低一阶的链表
+    while (cur > order)
     {
-        p_pre = p_next;
-        p_next = p_next->next;
+        cur--;
+        free_list_add(frame + (1U << cur), cur);
     }
 
-    // 不能与前后节点的内存范围相交
-    assert(p_pre == NULL || p_pre->addr + p_pre->count * PAGE_SIZE <= addr);
-    assert(p_next == NULL || addr + count * PAGE_SIZE <= p_next->addr);
+    frame->order = order;
+    pmu.count -= 1U << order;
+    pmu.zone_count[zone] -= 1U << order;
 
-    // 判断能否与后一节点合并
-    if (p_next != NULL && addr + PAGE_SIZE == p_next->addr)
+    if (pmu.zone_count[ZONE_NORMAL] < PMU_WMARK_LOW)
     {
-        // 合并到后一节点记录中
-        p_next->addr = addr;
-        p_next->count += count;
-        p = p_next;            // 将合并的节点记录为当前节点
-        p_next = p_next->next; // 更新后一节点指针
+        reclaim_wakeup();
     }
-    // 否则先插入一个新节点
-    else
+    return frame;
+}
+
+/**
+ * 从低端内存申请 2^order 页的块，内核可以直接访问
+ */
+static inline page_frame *buddy_alloc(uint32_t order)
+{
+    return buddy_alloc_zone(ZONE_NORMAL, order);
+}
+
+// 计算容纳 count 页所需的最小阶数
+static uint32_t count_to_order(size_t count)
+{
+    uint32_t order = 0;
+    while ((1U << order) < count)
     {
-        p = alloc_node(addr, count);
-        p->next = p_next;
-        if (p_pre == NULL)
-        {
-            pmu.head = p;
-        }
-        else
+        order++;
+    }
+    return order;
+}
+
+/**
+ * 将 [index, index + count) 范围的页按最大对齐块逐个释放
+ */
+static void buddy_free_range(size_t index, size_t count)
+{
+    while (count > 0)
+    {
+        uint32_t order = 0;
+        while (order < PMU_MAX_ORDER - 1 &&
+               (index & (1U << order)) == 0 &&
+               (2U << order) <= count)
         {
-            p_pre->next = p;
+            order++;
         }
+        buddy_free(index, order);
+        index += 1U << order;
+        count -= 1U << order;
     }
+}
 
-    // 判断当前节点能否与前一节点合并
-    if (p_pre != NULL && p_pre->addr + p_pre->count * PAGE_SIZE == addr)
+// 从预清零页池中取出一页，池为空时返回 NULL
+static page_frame *zero_pool_pop(void)
+{
+    page_frame *frame = zero_pool.head;
+    if (frame != NULL)
     {
-        p_pre->count += p->count; // 合并页面数量
-        free_node(p);             // 释放当前节点
-        p_pre->next = p_next;     // 修改下一节点指向
+        zero_pool.head = frame->next;
+        frame->next = NULL;
+        zero_pool.count--;
     }
+    return frame;
 }
 
 /**
  * 申请一个内存页
  *
- * @return 页起始地址，0 表示失败
+ * 低端内存耗尽时先同步回收，回收的可能都是高端内存的页，所以要重复回收
+ * 无法再回收时结束其他任务释放内存，没有可以结束的其他任务时返回 0，由调用者撤销已做的修改
+ *
+ * @return 页起始地址，0 表示内存耗尽
  */
 uint32_t pmu_alloc(void)
 {
-    if (pmu.count == 0)
+    page_frame *frame = buddy_alloc(0);
+    while (frame == NULL && reclaim_pages(SWAP_CLUSTER) > 0)
     {
-        panic("No free page");
+        frame = buddy_alloc(0);
+    }
+    while (frame == NULL && oom_kill() == 0)
+    {
+        frame = buddy_alloc(0);
+    }
+    if (frame == NULL)
+    {
+        DEBUGK("Out of memory");
         return 0;
     }
+    return frame_addr(frame);
+}
 
-    assert(pmu.head != NULL);
+/**
+ * 申请一个内容全为 0 的内存页
+ *
+ * 优先使用预清零页池中的页，池为空时申请普通页并同步清零
+ *
+ * @return 页起始地址，0 表示内存耗尽
+ */
+uint32_t pmu_alloc_zeroed(void)
+{
+    page_frame *frame = zero_pool_pop();
+    if (frame != NULL)
+    {
+        zero_pool.hits++;
+        return frame_addr(frame);
+    }
 
-    // 从第一个节点取出一页
-    uint32_t addr = pmu.head->addr;
-    pmu.head->addr += PAGE_SIZE;
-    --pmu.count;
-    --pmu.head->count;
+    zero_pool.misses++;
+    uint32_t addr = pmu_alloc();
+    if (addr != 0)
+    {
+        memset((void *)addr, 0, PAGE_SIZE);
+    }
+    return addr;
+}
 
-    // 如果节点被取空，则删除该节点
-    if (pmu.head->count == 0)
+/**
+ * 申请一个用户页
+ *
+ * 优先使用高端内存，把低端内存留给内核，高端内存耗尽时与 pmu_alloc 相同
+ * 内核访问返回的页时要使用 kmap，vmalloc 也使用这个函数申请页，通过自己的映射访问
+ *
+ * @return 页起始地址，0 表示内存耗尽
+ */
+uint32_t pmu_alloc_user(void)
+{
+    page_frame *frame = buddy_alloc_zone(ZONE_HIGH, 0);
+    if (frame == NULL)
     {
-        page_node *next = pmu.head->next;
-        free_node(pmu.head);
-        pmu.head = next;
+        return pmu_alloc();
     }
+    return frame_addr(frame);
+}
 
+/**
+ * 申请一个内容全为 0 的用户页
+ *
+ * 优先使用高端内存并通过临时映射清零，高端内存耗尽时与 pmu_alloc_zeroed 相同
+ *
+ * @return 页起始地址，0 表示内存耗尽
+ */
+uint32_t pmu_alloc_user_zeroed(void)
+{
+    page_frame *frame = buddy_alloc_zone(ZONE_HIGH, 0);
+    if (frame == NULL)
+    {
+        return pmu_alloc_zeroed();
+    }
+
+    uint32_t addr = frame_addr(frame);
+    void *page = kmap(addr);
+    memset(page, 0, PAGE_SIZE);
+    kunmap(page);
     return addr;
 }
 
+/**
+ * 向预清零页池补充一页
+ *
+ * 由空闲任务调用，调用者需要关闭中断，防止与其他任务同时修改页管理器
+ *
+ * @return 1 补充了一页，0 池已满或没有空闲页
+ */
+int pmu_zero_pool_refill(void)
+{
+    if (zero_pool.count >= ZERO_POOL_MAX)
+    {
+        return 0;
+    }
+
+    // 保留足够的空闲页给普通申请，空闲页不多时不再补充，避免与后台回收相互抵消
+    if (pmu.zone_count[ZONE_NORMAL] <= PMU_WMARK_HIGH)
+    {
+        return 0;
+    }
+
+    page_frame *frame = buddy_alloc(0);
+    if (frame == NULL)
+    {
+        return 0;
+    }
+    memset((void *)frame_addr(frame), 0, PAGE_SIZE);
+
+    frame->next = zero_pool.head;
+    zero_pool.head = frame;
+    zero_pool.count++;
+    zero_pool.refills++;
+    return 1;
+}
+
+static size_t zero_pool_count(void)
+{
+    return zero_pool.count;
+}
+
+// 将预清零页池中的页归还伙伴系统
+static size_t zero_pool_scan(size_t nr)
+{
+    size_t freed = 0;
+    page_frame *frame = NULL;
+    while (freed < nr && (frame = zero_pool_pop()) != NULL)
+    {
+        buddy_free(frame_index(frame), 0);
+        freed++;
+    }
+    return freed;
+}
+
+static shrinker zero_pool_shrinker = {
+    .name = "zero pool",
+    .count = zero_pool_count,
+    .scan = zero_pool_scan,
+};
+
 /**
  * 释放内存页
  *
@@ -176,24 +430,317 @@ void pmu_free(uint32_t addr)
     {
         return;
     }
-    pmu_add_record(addr, 1);
+    buddy_free(frame_index(addr_frame(addr)), 0);
+}
+
+/**
+ * 申请 2^order 个连续的内存页
+ *
+ * 没有足够大的块时收缩缓存后重试一次，不回收用户页，所以可以在回收用户页的过程中调用
+ *
+ * @param order 阶数，小于 PMU_MAX_ORDER
+ * @return 首页起始地址，0 表示失败
+ */
+uint32_t pmu_alloc_pages(uint32_t order)
+{
+    assert(order < PMU_MAX_ORDER);
+
+    page_frame *frame = buddy_alloc(order);
+    if (frame == NULL && shrink_caches(1U << order) > 0)
+    {
+        frame = buddy_alloc(order);
+    }
+    if (frame == NULL)
+    {
+        DEBUGK("No free block of order %u", order);
+        return 0;
+    }
+    return frame_addr(frame);
+}
+
+/**
+ * 释放 pmu_alloc_pages 申请的连续内存页
+ *
+ * @param addr 首页地址，不得为 0
+ * @param order 申请时的阶数
+ */
+void pmu_free_pages(uint32_t addr, uint32_t order)
+{
+    if (addr == 0)
+    {
+        return;
+    }
+    assert(order < PMU_MAX_ORDER);
+    buddy_free(frame_index(addr_frame(addr)), order);
+}
+
+void pmu_batch_init(pmu_batch *batch)
+{
+    batch->count = 0;
+}
+
+/**
+ * 将不再使用的页加入批次，批次满时释放
+ *
+ * @param addr 页地址，没有其他映射，为 0 时不做任何处理
+ */
+void pmu_batch_add(pmu_batch *batch, uint32_t addr)
+{
+    if (addr == 0)
+    {
+        return;
+    }
+    if (batch->count == PMU_BATCH_SIZE)
+    {
+        pmu_batch_flush(batch);
+    }
+    batch->addrs[batch->count++] = addr;
+}
+
+/**
+ * 释放批次中的所有页
+ *
+ * 进程的页往往是连续申请的，物理地址相邻的页按地址排序后拼成连续范围，由 buddy_free_range 直接按大块释放
+ * 比逐页释放少了逐阶查找伙伴合并的过程；范围在区域边界处断开，块不能跨越区域
+ */
+void pmu_batch_flush(pmu_batch *batch)
+{
+    // 批次很小，插入排序即可
+    for (uint32_t i = 1; i < batch->count; i++)
+    {
+        uint32_t addr = batch->addrs[i];
+        uint32_t j = i;
+        for (; j > 0 && batch->addrs[j - 1] > addr; j--)
+        {
+            batch->addrs[j] = batch->addrs[j - 1];
+        }
+        batch->addrs[j] = addr;
+    }
+
+    for (uint32_t i = 0; i < batch->count;)
+    {
+        size_t start = frame_index(addr_frame(batch->addrs[i]));
+        size_t count = 1;
+        assert(!(pmu.frames[start].flags & PF_FREE));
+        while (i + count < batch->count &&
+               frame_index(addr_frame(batch->addrs[i + count])) == start + count &&
+               index_zone(start + count) == index_zone(start))
+        {
+            assert(!(pmu.frames[start + count].flags & PF_FREE));
+            count++;
+        }
+        buddy_free_range(start, count);
+        i += count;
+    }
+    batch->count = 0;
+}
+
+/**
+ * 申请连续的内存页
+ *
+ * 先申请能容纳 count 页的最小块，再将多余的尾部页归还
+ *
+ * @param count 页数量，不超过 2^(PMU_MAX_ORDER - 1)
+ * @return 首页起始地址，0 表示失败
+ */
+uint32_t pmu_alloc_contiguous(size_t count)
+{
+    assert(count != 0);
+
+    uint32_t order = count_to_order(count);
+    if (order >= PMU_MAX_ORDER)
+    {
+        DEBUGK("%u pages exceed the max block size", count);
+        return 0;
+    }
+
+    page_frame *frame = buddy_alloc(order);
+    if (frame == NULL)
+    {
+        DEBUGK("No %u contiguous free pages", count);
+        return 0;
+    }
+
+    // 归还多余的尾部页
+    buddy_free_range(frame_index(frame) + count, (1U << order) - count);
+    return frame_addr(frame);
+}
+
+/**
+ * 释放连续的内存页
+ *
+ * @param addr 首页地址，不得为 0
+ * @param count 页数量
+ */
+void pmu_free_contiguous(uint32_t addr, size_t count)
+{
+    if (addr == 0)
+    {
+        return;
+    }
+    buddy_free_range(frame_index(addr_frame(addr)), count);
+}
+
+/**
+ * 增加页的共享映射
+ *
+ * fork 时父子进程共享同一物理页，每多一个映射调用一次
+ */
+void pmu_page_get(uint32_t addr)
+{
+    page_frame *frame = addr_frame(addr);
+    assert(!(frame->flags & (PF_FREE | PF_SLAB)));
+    frame->mapcount++;
+}
+
+/**
+ * 解除页的一个映射，没有其他映射时释放该页
+ */
+void pmu_page_put(uint32_t addr)
+{
+    page_frame *frame = addr_frame(addr);
+    if (frame->mapcount > 0)
+    {
+        frame->mapcount--;
+        return;
+    }
+    buddy_free(frame_index(frame), 0);
+}
+
+/**
+ * 检查页是否被多个映射共享
+ */
+int pmu_page_shared(uint32_t addr)
+{
+    return addr_frame(addr)->mapcount > 0;
+}
+
+/**
+ * 获取空闲页数量
+ */
+size_t pmu_free_count(void)
+{
+    return pmu.count;
+}
+
+/**
+ * 获取低端内存的空闲页数量，与水位比较
+ */
+size_t pmu_lowmem_free_count(void)
+{
+    return pmu.zone_count[ZONE_NORMAL];
+}
+
+/**
+ * 输出各阶空闲块数量
+ */
+void pmu_info(void)
+{
+    printk("free pages: %u / %u, high memory %u / %u\n", pmu.count, pmu.usable,
+           pmu.zone_count[ZONE_HIGH], pmu.high_usable);
+    printk("order ");
+    for (uint32_t order = 0; order < PMU_MAX_ORDER; order++)
+    {
+        printk("%6u", order);
+    }
+    printk("\nblocks");
+    for (uint32_t order = 0; order < PMU_MAX_ORDER; order++)
+    {
+        printk("%6u", pmu.free_blocks[ZONE_NORMAL][order]);
+    }
+    printk("\nhigh  ");
+    for (uint32_t order = 0; order < PMU_MAX_ORDER; order++)
+    {
+        printk("%6u", pmu.free_blocks[ZONE_HIGH][order]);
+    }
+    printk("\n");
+    printk("zero pool: %u pages, %u hits, %u misses, %u refills\n",
+           zero_pool.count, zero_pool.hits, zero_pool.misses, zero_pool.refills);
 }
 
 /**
  * 初始化内存页管理器
  *
- * @param addr 空页起始地址
- * @param count 空闲页数量
+ * 页元数据数组占用范围开头的若干页，这些页必须是可用内存
+ * 初始化后所有页都处于已分配状态，由 pmu_add_range 将可用的部分加入空闲链表
+ *
+ * @param addr 管理范围的起始地址
+ * @param count 管理范围的页数量，包括其中的空洞
  */
 void pmu_init(uint32_t addr, size_t count)
 {
-    pmu.count = 0;
-    while (pmu.head != NULL)
+    assert(addr != 0);
+    assert((addr & 0xFFF) == 0);
+
+    // 元数据只需要覆盖除自身以外的页，这里按全部页计算，最多多占用一页
+    size_t meta_pages = CEIL_DIV(count * sizeof(page_frame), PAGE_SIZE);
+    assert(meta_pages < count);
+
+    memset(&pmu, 0, sizeof(pmu));
+    pmu.frames = (page_frame *)addr;
+    pmu.base = addr + meta_pages * PAGE_SIZE;
+    pmu.total = count - meta_pages;
+    pmu.high_index = pmu.total;
+    memset(pmu.frames, 0, pmu.total * sizeof(page_frame));
+
+    // 预清零页不需要写回，最先回收
+    register_shrinker(&zero_pool_shrinker);
+
+    DEBUGK("pmu: %u pages at %p, %u pages for metadata", pmu.total, pmu.base, meta_pages);
+}
+
+/**
+ * 设置高端内存的起始地址，之后的页内核没有恒等映射
+ *
+ * 必须在 pmu_add_range 之前调用，不调用时所有页都属于低端内存
+ *
+ * @param addr 高端内存起始地址，页对齐
+ */
+void pmu_set_highmem(uint32_t addr)
+{
+    assert((addr & 0xFFF) == 0);
+    assert(pmu.count == 0);
+
+    addr = MAX(addr, pmu.base);
+    pmu.high_index = MIN((addr - pmu.base) / PAGE_SIZE, pmu.total);
+}
+
+/**
+ * 将可用的物理内存范围加入空闲链表
+ *
+ * 范围超出管理范围的部分（包括元数据占用的页）会被忽略
+ * 跨越高端内存边界的范围分成两部分加入，保证伙伴系统的块不跨越区域
+ *
+ * @param addr 起始地址，页对齐
+ * @param count 页数量
+ */
+void pmu_add_range(uint32_t addr, size_t count)
+{
+    assert((addr & 0xFFF) == 0);
+
+    uint32_t end = MIN(addr + count * PAGE_SIZE, pmu.base + pmu.total * PAGE_SIZE);
+    addr = MAX(addr, pmu.base);
+    if (addr >= end)
+    {
+        return;
+    }
+
+    size_t index = (addr - pmu.base) / PAGE_SIZE;
+    size_t pages = (end - addr) / PAGE_SIZE;
+    if (index < pmu.high_index && index + pages > pmu.high_index)
+    {
+        buddy_free_range(index, pmu.high_index - index);
+        buddy_free_range(pmu.high_index, index + pages - pmu.high_index);
+    }
+    else
     {
-        page_node *next = pmu.head->next;
-        free_node(pmu.head);
-        pmu.head = next;
+        buddy_free_range(index, pages);
     }
-    memset(bitmap, 0, sizeof(bitmap));
-    pmu_add_record(addr, count);
-}
\ No newline at end of file
+    pmu.usable += pages;
+    if (index + pages > pmu.high_index)
+    {
+        pmu.high_usable += index + pages - MAX(index, pmu.high_index);
+    }
+
+    DEBUGK("pmu: %u free pages at %p", pages, addr);
+}
@@ -0,0 +1,165 @@
+#include "kernel/reaper.h"
+#include "kernel/pmu.h"
+#include "kernel/task.h"
+#include "kernel/scheduler.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+
+/**
+ * 地址空间的延迟释放
+ *
+ * 释放地址空间要遍历所有用户页表，逐页解除映射、释放页和交换槽位，大进程退出时耗时很长
+ * 进程退出或 exec 时只把页目录和区域放入队列，由后台释放任务在之后逐个释放，退出的进程可以立即让出 CPU
+ * 释放时页和页表积攒成批，按物理地址合并为大块归还伙伴系统
+ *
+ * 排队的地址空间已经不属于任何任务，换出、相同页合并和 OOM 都不会再扫描它
+ * 内存紧张时回收先同步释放整个队列，再收缩缓存和回收用户页；队列满时直接同步释放
+ */
+
+// 等待释放的地址空间
+typedef struct reap_item
+{
+    page_dir_entry *page_dir;
+    vm_map vmas;
+} reap_item;
+
+static task_struct *reaper_task = NULL; // 后台释放任务
+
+// 等待释放的地址空间队列，先进先出
+static struct
+{
+    reap_item items[REAPER_QUEUE_SIZE];
+    uint32_t head;  // 队首下标
+    uint32_t count; // 排队的数量
+} queue = {0};
+
+// 统计信息
+static struct
+{
+    uint32_t deferred; // 延迟释放的地址空间数量
+    uint32_t reaped;   // 后台释放的地址空间数量
+    uint32_t drained;  // 内存紧张时同步释放的地址空间数量
+    uint32_t sync;     // 队列满时同步释放的地址空间数量
+    uint32_t pages;    // 释放地址空间归还的页数
+    uint32_t max;      // 队列的最大长度
+} stats = {0};
+
+static void free_address_space(page_dir_entry *page_dir, vm_map *vmas)
+{
+    size_t before = pmu_free_count();
+    free_user_page_dir(page_dir);
+    vma_free(vmas);
+    stats.pages += pmu_free_count() - before;
+}
+
+/**
+ * 释放队首的地址空间，调用者需要关闭中断
+ */
+static void reap_one(void)
+{
+    reap_item *item = &queue.items[queue.head];
+    queue.head = (queue.head + 1) % REAPER_QUEUE_SIZE;
+    queue.count--;
+    free_address_space(item->page_dir, &item->vmas);
+}
+
+/**
+ * 将地址空间交给后台释放任务
+ *
+ * 页目录是当前页目录时先切换到内核页目录，TLB 中不会再留有其中的条目
+ *
+ * @param page_dir 用户页目录
+ * @param vmas 地址空间区域，内容转移到队列中，返回时清空
+ */
+void reaper_defer(page_dir_entry *page_dir, vm_map *vmas)
+{
+    assert(page_dir != NULL && page_dir != get_kernel_page_dir());
+
+    if (get_cr3() == (uint32_t)page_dir)
+    {
+        switch_page_dir(get_kernel_page_dir());
+    }
+    if (reaper_task == NULL || queue.count == REAPER_QUEUE_SIZE)
+    {
+        stats.sync++;
+        free_address_space(page_dir, vmas);
+        *vmas = (vm_map){0};
+        return;
+    }
+
+    reap_item *item = &queue.items[(queue.head + queue.count) % REAPER_QUEUE_SIZE];
+    item->page_dir = page_dir;
+    item->vmas = *vmas;
+    *vmas = (vm_map){0};
+    queue.count++;
+    stats.deferred++;
+    stats.max = MAX(stats.max, queue.count);
+
+    if (reaper_task->state == TASK_BLOCKED || reaper_task->state == TASK_NONE)
+    {
+        switch_task_state(reaper_task, TASK_READY);
+    }
+}
+
+/**
+ * 同步释放所有排队的地址空间，由内存回收在收缩缓存之前调用
+ *
+ * 调用者需要关闭中断
+ *
+ * @return 归还的页数
+ */
+size_t reaper_drain(void)
+{
+    size_t before = pmu_free_count();
+    while (queue.count > 0)
+    {
+        reap_one();
+        stats.drained++;
+    }
+    return pmu_free_count() - before;
+}
+
+/**
+ * 后台释放任务
+ *
+ * 每次释放一个地址空间，期间关闭中断，两次之间打开中断让时钟中断可以调度其他任务
+ * 队列为空时阻塞，等待 reaper_defer 唤醒
+ */
+static void reaper(void)
+{
+    while (1)
+    {
+        cli();
+        if (queue.count > 0)
+        {
+            reap_one();
+            stats.reaped++;
+        }
+        else
+        {
+            switch_task_state(reaper_task, TASK_BLOCKED);
+            schedule();
+        }
+        sti();
+    }
+}
+
+/**
+ * 输出延迟释放的统计信息
+ */
+void reaper_info(void)
+{
+    printk("reaper: %u queued, %u deferred, %u reaped, %u drained, %u sync, %u pages, max queue %u\n",
+           queue.count, stats.deferred, stats.reaped, stats.drained, stats.sync, stats.pages, stats.max);
+}
+
+/**
+ * 创建后台释放任务，在初始任务之后创建
+ */
+void reaper_init(void)
+{
+    // 任务创建后不在任何队列中，首次有地址空间排队时才由 reaper_defer 加入就绪队列
+    reaper_task = create_kernel_task(reaper);
+    assert(reaper_task != NULL);
+}
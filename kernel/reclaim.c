@@ -0,0 +1,257 @@
+#include "kernel/reclaim.h"
+#include "kernel/pmu.h"
+#include "kernel/swap.h"
+#include "kernel/reaper.h"
+#include "kernel/task.h"
+#include "kernel/scheduler.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+
+/**
+ * 内存回收
+ *
+ * 可回收的内存分为两类：
+ * - 缓存：预清零页、空闲 slab、预读缓冲区等，丢弃后只需要重新填充，由各子系统注册的收缩器释放
+ * - 用户页：换出到 zram 或交换分区，或者直接丢弃可以重新读取的页，由 swap_reclaim 完成
+ * 回收总是先释放已退出进程排队等待释放的地址空间，再收缩缓存，不够时最后回收用户页
+ *
+ * 低端内存的空闲页低于 PMU_WMARK_LOW 时，页管理器唤醒后台回收任务，回收到 PMU_WMARK_HIGH 为止
+ * 这样大部分申请不会遇到内存耗尽，不需要在缺页异常或系统调用中同步回收
+ * 后台回收来不及时，pmu_alloc 直接同步回收；缓存和用户页都无法回收时由 oom_kill 结束一个任务释放内存
+ * pmu_alloc 只结束其他任务，只剩当前任务可以结束时返回 0，当前任务在回到用户态前由 oom_check 结束
+ */
+
+static shrinker *shrinkers = NULL;      // 按注册顺序排列的收缩器链表
+static task_struct *reclaim_task = NULL; // 后台回收任务
+
+// 统计信息
+static struct
+{
+    uint32_t wakeups; // 唤醒后台回收的次数
+    uint32_t kswapd;  // 后台回收的页数
+    uint32_t direct;  // 同步回收的次数
+    uint32_t kills;   // 因内存耗尽结束的任务数
+} stats = {0};
+
+/**
+ * 注册收缩器，加入链表末尾
+ */
+void register_shrinker(shrinker *s)
+{
+    s->freed = 0;
+    s->next = NULL;
+
+    shrinker **pos = &shrinkers;
+    while (*pos != NULL)
+    {
+        pos = &(*pos)->next;
+    }
+    *pos = s;
+}
+
+/**
+ * 依次调用收缩器释放缓存，不回收用户页
+ *
+ * 不会进入 swap_reclaim，所以可以在回收用户页的过程中调用
+ *
+ * @param count 希望释放的页数
+ * @return 实际释放的页数
+ */
+size_t shrink_caches(size_t count)
+{
+    size_t freed = 0;
+    for (shrinker *s = shrinkers; s != NULL && freed < count; s = s->next)
+    {
+        size_t n = s->scan(count - freed);
+        s->freed += n;
+        freed += n;
+    }
+    return freed;
+}
+
+/**
+ * 回收内存，先释放排队的地址空间，再收缩缓存，不够时再回收用户页
+ *
+ * 调用者需要关闭中断
+ *
+ * @param count 希望释放的页数
+ * @return 实际释放的页数
+ */
+size_t reclaim_pages(size_t count)
+{
+    if (running_task(0) != reclaim_task)
+    {
+        stats.direct++;
+    }
+
+    size_t freed = reaper_drain();
+    if (freed < count)
+    {
+        freed += shrink_caches(count - freed);
+    }
+    if (freed < count)
+    {
+        freed += swap_reclaim(count - freed);
+    }
+    return freed;
+}
+
+/**
+ * 唤醒后台回收任务，由页管理器在低端内存空闲页低于 PMU_WMARK_LOW 时调用
+ */
+void reclaim_wakeup(void)
+{
+    if (reclaim_task != NULL && (reclaim_task->state == TASK_BLOCKED || reclaim_task->state == TASK_NONE))
+    {
+        stats.wakeups++;
+        switch_task_state(reclaim_task, TASK_READY);
+    }
+}
+
+/**
+ * 后台回收任务
+ *
+ * 每次回收一批页，期间关闭中断，两批之间打开中断让时钟中断可以调度其他任务
+ * 空闲页达到 PMU_WMARK_HIGH 时阻塞，等待 reclaim_wakeup 唤醒
+ * 回收的用户页可能都在高端内存，低端内存的空闲页没有增加时同样阻塞，避免把所有用户页都换出
+ */
+static void kswapd(void)
+{
+    while (1)
+    {
+        cli();
+        size_t before = pmu_lowmem_free_count();
+        size_t freed = 0;
+        if (before < PMU_WMARK_HIGH)
+        {
+            freed = reclaim_pages(SWAP_CLUSTER);
+            stats.kswapd += freed;
+        }
+        if (freed == 0 || pmu_lowmem_free_count() <= before)
+        {
+            switch_task_state(reclaim_task, TASK_BLOCKED);
+            schedule();
+        }
+        sti();
+    }
+}
+
+// 可以结束的任务：拥有用户地址空间，并且不是初始任务
+static inline int killable(const task_struct *task)
+{
+    return task != NULL && task->pid != INIT_PID && task->page_dir != NULL &&
+           task->page_dir != get_kernel_page_dir();
+}
+
+// 任务映射的用户页数量
+static uint32_t task_rss(const task_struct *task)
+{
+    uint32_t rss = 0;
+    for (uint32_t i = kernel_area_page_dir_end_index; i < 1024; i++)
+    {
+        const page_dir_entry *pde = &task->page_dir[i];
+        if (!pde->present || !pde->us)
+        {
+            continue;
+        }
+        const page_tabel_entry *page_table = (const page_tabel_entry *)(pde->addr << 12);
+        for (uint32_t j = 0; j < 1024; j++)
+        {
+            rss += page_table[j].present;
+        }
+    }
+    return rss;
+}
+
+/**
+ * 内存耗尽时结束一个其他任务，释放它的地址空间
+ *
+ * 选择映射页最多的任务，释放的内存最多
+ * 当前任务可能正在系统调用中修改自己的页表，或者持有临时映射、半初始化的对象，不能在申请内存的途中结束
+ * 只剩当前任务可以结束时只做标记，申请失败后由调用者撤销已做的修改，再由 oom_check 在安全的位置结束
+ *
+ * @return 0 已结束其他任务，-1 没有可以立即结束的任务
+ */
+int oom_kill(void)
+{
+    task_struct *current = running_task(0);
+    task_struct *victim = NULL;
+    uint32_t victim_rss = 0;
+    for (uint32_t i = 0; i < NR_TASKS; i++)
+    {
+        task_struct *task = task_at(i);
+        if (task == current || !killable(task))
+        {
+            continue;
+        }
+        uint32_t rss = task_rss(task);
+        if (victim == NULL || rss > victim_rss)
+        {
+            victim = task;
+            victim_rss = rss;
+        }
+    }
+    if (victim == NULL)
+    {
+        if (killable(current) && !current->oom_killed)
+        {
+            printk("out of memory: killing task %d (%u pages)\n", current->pid, task_rss(current));
+            current->oom_killed = 1;
+            stats.kills++;
+        }
+        return -1;
+    }
+
+    printk("out of memory: killed task %d (%u pages)\n", victim->pid, victim_rss);
+    stats.kills++;
+
+    switch_task_state(victim, TASK_ZOMBIE);
+    task_exit(victim, -1);
+    // 地址空间进入了延迟释放队列，要立即释放，调用者才能申请到内存
+    reaper_drain();
+    return 0;
+}
+
+/**
+ * 结束被 oom_kill 标记的当前任务
+ *
+ * 在系统调用返回前和缺页处理失败时调用，此时申请失败的操作已经撤销，不持有任何临时状态
+ * 当前任务被标记时调度其他任务，不会返回
+ */
+void oom_check(void)
+{
+    task_struct *current = running_task(0);
+    if (current == NULL || !current->oom_killed)
+    {
+        return;
+    }
+
+    switch_task_state(current, TASK_ZOMBIE);
+    task_exit(current, -1);
+    schedule_handler(NULL);
+    panic("oom_check: no task to switch");
+}
+
+/**
+ * 输出内存回收的统计信息
+ */
+void reclaim_info(void)
+{
+    printk("reclaim: watermark %u/%u, %u lowmem pages free, %u wakeups, %u background pages, %u direct, %u oom kills\n",
+           PMU_WMARK_LOW, PMU_WMARK_HIGH, pmu_lowmem_free_count(), stats.wakeups, stats.kswapd, stats.direct,
+           stats.kills);
+    for (const shrinker *s = shrinkers; s != NULL; s = s->next)
+    {
+        printk("  %-12s %6u reclaimable %8u freed\n", s->name, s->count(), s->freed);
+    }
+}
+
+/**
+ * 创建后台回收任务，在初始任务之后创建
+ */
+void reclaim_init(void)
+{
+    // 任务创建后不在任何队列中，首次内存紧张时才由 reclaim_wakeup 加入就绪队列
+    reclaim_task = create_kernel_task(kswapd);
+    assert(reclaim_task != NULL);
+}
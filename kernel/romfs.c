@@ -0,0 +1,216 @@
+#include "kernel/romfs.h"
+#include "kernel/fs.h"
+#include "kernel/vmalloc.h"
+#include "kernel/page.h"
+#include "kernel/lz4.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+#define ROMFS_IMAGE_PATH "/romfs.img" // romfs 镜像在 FAT16 分区中的路径
+
+static struct
+{
+    const romfs_header *header; // 镜像起始地址，NULL 表示未挂载
+    const uint32_t *hash_table;
+    const romfs_entry *entries;
+    const char *names;
+    void **unpacked; // 压缩文件解压后的数据，按条目下标索引，首次访问时解压
+} romfs = {.header = NULL};
+
+/**
+ * 根据路径查找文件条目
+ *
+ * @param path 文件绝对路径
+ * @return 文件条目，NULL 表示未找到或未挂载
+ */
+const romfs_entry *romfs_find(const char *path)
+{
+    if (romfs.header == NULL || path == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t hash = romfs_hash(path);
+    uint32_t mask = romfs.header->hash_size - 1;
+    size_t len = strlen(path);
+
+    // 线性探测，遇见空槽位说明不存在
+    for (uint32_t i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, n++)
+    {
+        uint32_t slot = romfs.hash_table[i];
+        if (slot == 0)
+        {
+            break;
+        }
+
+        const romfs_entry *entry = &romfs.entries[slot - 1];
+        if (entry->hash == hash &&
+            entry->name_len == len &&
+            memcmp(romfs.names + entry->name_offset, path, len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 获取文件数据在内存中的起始地址
+ *
+ * 未压缩的文件直接返回镜像内的地址（页对齐，可直接映射）
+ * 压缩的文件在首次访问时解压到 vmalloc 申请的内存中
+ *
+ * @return 文件数据地址，NULL 表示失败
+ */
+const void *romfs_file_data(const romfs_entry *entry)
+{
+    assert(romfs.header != NULL);
+
+    if ((entry->flags & ROMFS_FLAG_LZ4) == 0)
+    {
+        return (const uint8_t *)romfs.header + entry->data_offset;
+    }
+
+    size_t index = entry - romfs.entries;
+    if (romfs.unpacked[index] == NULL)
+    {
+        void *data = vmalloc(MAX(entry->size, 1));
+        if (data == NULL)
+        {
+            DEBUGK("romfs: no memory to unpack file");
+            return NULL;
+        }
+        const void *src = (const uint8_t *)romfs.header + entry->data_offset;
+        if (lz4_decompress(src, entry->stored_size, data, entry->size) != (int)entry->size)
+        {
+            DEBUGK("romfs: corrupted compressed data");
+            vfree(data);
+            return NULL;
+        }
+        romfs.unpacked[index] = data;
+    }
+    return romfs.unpacked[index];
+}
+
+/**
+ * 读取文件
+ *
+ * @return 实际读取的字节数
+ */
+size_t romfs_read(void *dst, off_t offset, size_t size, const romfs_entry *entry)
+{
+    if (offset >= entry->size)
+    {
+        return 0;
+    }
+    size = MIN(size, entry->size - offset);
+
+    const uint8_t *data = romfs_file_data(entry);
+    if (data == NULL)
+    {
+        return 0;
+    }
+    memcpy(dst, data + offset, size);
+    return size;
+}
+
+/**
+ * 校验镜像头部记录的各区域是否位于镜像内部
+ */
+static int romfs_check_header(const romfs_header *header)
+{
+    if (header->magic != ROMFS_MAGIC || header->version != ROMFS_VERSION)
+    {
+        return -1;
+    }
+    // 哈希表大小必须是 2 的幂，且至少比条目数量多一个空槽位
+    if (header->hash_size == 0 ||
+        (header->hash_size & (header->hash_size - 1)) != 0 ||
+        header->hash_size <= header->entry_count)
+    {
+        return -1;
+    }
+    if (header->hash_offset + header->hash_size * sizeof(uint32_t) > header->image_size ||
+        header->entry_offset + header->entry_count * sizeof(romfs_entry) > header->image_size ||
+        header->name_offset > header->image_size)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 挂载 romfs 镜像
+ *
+ * 从 FAT16 分区读取镜像文件到 vmalloc 申请的内存中，镜像大小不受物理连续内存的限制
+ * 镜像不存在时不做处理，文件访问将继续使用 FAT16
+ */
+void romfs_init(void)
+{
+    file_struct file;
+    if (file_open(ROMFS_IMAGE_PATH, &file) != 0)
+    {
+        DEBUGK("romfs image not found, use FAT16 only");
+        return;
+    }
+
+    romfs_header header;
+    if (file_read(&header, 0, sizeof(header), &file) != sizeof(header) ||
+        romfs_check_header(&header) != 0)
+    {
+        DEBUGK("invalid romfs image");
+        return;
+    }
+
+    // 将整个镜像读入线性地址连续的内存
+    void *image = vmalloc(header.image_size);
+    if (image == NULL)
+    {
+        DEBUGK("no memory for romfs image");
+        return;
+    }
+    // 整体读取前先缓存簇链，避免逐簇查询 FAT 表
+    file_cache_extents(&file);
+    size_t read_size = file_read(image, 0, header.image_size, &file);
+    file_close(&file);
+    if (read_size != header.image_size)
+    {
+        DEBUGK("read romfs image failed");
+        vfree(image);
+        return;
+    }
+
+    // 校验所有条目的数据范围
+    const romfs_entry *entries = image + header.entry_offset;
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        if (entries[i].data_offset % ROMFS_ALIGN != 0 ||
+            entries[i].data_offset + entries[i].stored_size > header.image_size ||
+            header.name_offset + entries[i].name_offset + entries[i].name_len > header.image_size)
+        {
+            DEBUGK("invalid romfs entry %u", i);
+            vfree(image);
+            return;
+        }
+    }
+
+    // 解压数据缓存表
+    size_t unpacked_size = MAX(header.entry_count * sizeof(void *), 1);
+    void **unpacked = vmalloc(unpacked_size);
+    if (unpacked == NULL)
+    {
+        DEBUGK("no memory for romfs image");
+        vfree(image);
+        return;
+    }
+    memset(unpacked, 0, unpacked_size);
+
+    romfs.hash_table = image + header.hash_offset;
+    romfs.entries = entries;
+    romfs.names = image + header.name_offset;
+    romfs.unpacked = unpacked;
+    romfs.header = image;
+
+    DEBUGK("romfs mounted: %u files, %u bytes", header.entry_count, header.image_size);
+}
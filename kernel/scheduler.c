@@ -2,6 +2,9 @@
 #include "kernel/timer.h"
 #include "kernel/pic.h"
 #include "kernel/kernel.h"
+#include "kernel/pmu.h"
+#include "kernel/ksm.h"
+#include "kernel/x86.h"
 
 typedef struct task_list
 {
@@ -10,6 +13,7 @@ typedef struct task_list
 } task_list;
 
 static task_struct *current_task = NULL;
+static task_struct *idle_task = NULL; // 空闲任务，没有就绪任务时运行，不加入就绪队列
 static task_list ready_tasks = {NULL, NULL};
 static task_list blocked_tasks = {NULL, NULL};
 
@@ -68,19 +72,23 @@ static int task_list_remove(task_list *list, task_struct *target)
         return -1;
     }
 
-    // 修改头尾节点
-    if (task == list->head)
+    // 从链表中移除节点，同时修改头尾节点
+    if (task->prev != NULL)
+    {
+        task->prev->next = task->next;
+    }
+    else
     {
         list->head = task->next;
     }
-    if (task == list->tail)
+    if (task->next != NULL)
+    {
+        task->next->prev = task->prev;
+    }
+    else
     {
         list->tail = task->prev;
     }
-
-    // 从链表中移除节点
-    task->prev->next = task->next;
-    task->next->prev = task->prev;
     task->prev = task->next = NULL;
 
     return 0;
@@ -114,8 +122,8 @@ static void switch_to_running_state(task_struct *task)
         break;
     }
 
-    // 将正在执行的任务状态设为 READY
-    if (running_task(0) != NULL)
+    // 将正在执行的任务状态设为 READY，已阻塞的任务保持不变
+    if (running_task(0) != NULL && running_task(1)->state == TASK_RUNNING)
     {
         switch_task_state(running_task(1), TASK_READY);
     }
@@ -135,6 +143,9 @@ static void switch_to_ready_state(task_struct *task)
     case TASK_RUNNING:
         current_task = NULL;
         break;
+    case TASK_BLOCKED:
+        task_list_remove(&blocked_tasks, task);
+        break;
 
     default:
         panic("invalid task state %d switch to ready state", task->state);
@@ -142,9 +153,35 @@ static void switch_to_ready_state(task_struct *task)
     }
 
     task->state = TASK_READY;
-    task_list_add(&ready_tasks, task);
+    // 空闲任务只在没有就绪任务时运行，不加入就绪队列
+    if (task != idle_task)
+    {
+        task_list_add(&ready_tasks, task);
+    }
 }
 
+/**
+ * NOTE: 阻塞的任务仍然是当前任务，直到调度器切换到其他任务时保存它的中断栈帧
+ */
+static void switch_to_blocked_state(task_struct *task)
+{
+    switch (task->state)
+    {
+    case TASK_RUNNING:
+        break;
+
+    default:
+        panic("invalid task state %d switch to blocked state", task->state);
+        break;
+    }
+
+    task->state = TASK_BLOCKED;
+    task_list_add(&blocked_tasks, task);
+}
+
+/**
+ * 就绪或阻塞的任务被内存耗尽处理结束时，从所在的队列中移除，之后不会再被调度
+ */
 static void switch_to_zombie_state(task_struct *task)
 {
     switch (task->state)
@@ -152,6 +189,12 @@ static void switch_to_zombie_state(task_struct *task)
     case TASK_RUNNING:
         current_task = NULL;
         break;
+    case TASK_READY:
+        task_list_remove(&ready_tasks, task);
+        break;
+    case TASK_BLOCKED:
+        task_list_remove(&blocked_tasks, task);
+        break;
 
     default:
         panic("invalid task state %d switch to zombie state", task->state);
@@ -192,6 +235,9 @@ void switch_task_state(task_struct *task, enum task_state state)
     case TASK_READY:
         switch_to_ready_state(task);
         break;
+    case TASK_BLOCKED:
+        switch_to_blocked_state(task);
+        break;
     case TASK_ZOMBIE:
         switch_to_zombie_state(task);
         break;
@@ -206,7 +252,7 @@ void switch_task_state(task_struct *task, enum task_state state)
 /**
  * 调度下一个任务
  * 
- * NOTE: 则该函数不会返回
+ * NOTE: 该函数不会返回
  */
 void schedule_handler(interrupt_frame *frame)
 {
@@ -220,24 +266,51 @@ void schedule_handler(interrupt_frame *frame)
     task_struct *next_task = get_next_ready_task();
     if (next_task == NULL)
     {
-        // 未找到任务，则继续调度当前任务
-        context_switch_to(running_task(1));
+        // 未找到任务，当前任务仍可运行则继续调度当前任务，否则运行空闲任务
+        if (current_task != NULL && current_task->state == TASK_RUNNING)
+        {
+            context_switch_to(current_task);
+        }
+        next_task = idle_task;
     }
 
     // 切换到下一个任务
     switch_task_state(next_task, TASK_RUNNING);
 }
 
+/**
+ * 空闲任务
+ *
+ * 没有就绪任务时运行，利用空闲时间补充预清零页池，池已满后扫描合并相同的页，一轮扫描完成后休眠等待中断
+ * 每次只清零一页或扫描一批页，期间关闭中断，防止被调度出去时其他任务同时修改页管理器和页表
+ */
+static void idle(void)
+{
+    while (1)
+    {
+        cli();
+        int busy = pmu_zero_pool_refill() || ksm_scan(KSM_SCAN_BATCH);
+        sti();
+
+        if (!busy)
+        {
+            asm volatile("hlt");
+        }
+    }
+}
+
 void scheduler_init(task_struct *init_task)
 {
+    // 创建空闲任务
+    idle_task = create_kernel_task(idle);
+    assert(idle_task != NULL);
+    idle_task->state = TASK_READY;
+
     // 添加初始任务到调度队列
     switch_task_state(init_task, TASK_READY);
     // 启用时钟中断
     start_timer();
 
-    // 让 CPU 进入休眠状态，等待时钟中断
-    while (1)
-    {
-        asm volatile("hlt");
-    }
+    // 从空闲任务开始运行，首次时钟中断时切换到初始任务
+    switch_task_state(idle_task, TASK_RUNNING);
 }
\ No newline at end of file
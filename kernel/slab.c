@@ -0,0 +1,399 @@
+#include "kernel/slab.h"
+#include "kernel/page.h"
+#include "kernel/reclaim.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * slab 对象缓存
+ *
+ * 同一类型的对象从专属的缓存中分配，每个缓存由若干 slab 组成
+ * slab 按已分配对象数量放在 partial/full/empty 三个链表中，申请时优先使用 partial 链表的首个 slab
+ * 空闲对象组成单向链表，释放的对象放回链表头部，下次申请时最先被取出，此时它很可能仍在 CPU 缓存中
+ * 申请和释放都只需要操作链表头部，时间复杂度为 O(1)
+ *
+ * 带构造函数的缓存中，对象在 slab 创建时构造一次，释放时调用者要将对象恢复为构造后的状态
+ * 这样申请时就不需要重新初始化对象
+ */
+
+#define SLAB_MAX_ORDER 3 // slab 的最大页阶数
+#define SLAB_MAX_EMPTY 1 // 每个缓存最多保留的空闲 slab 数量，多余的归还伙伴系统，保留的在内存紧张时由收缩器归还
+
+static kmem_cache cache_cache;         // 管理 kmem_cache 结构体自身的缓存
+static kmem_cache *cache_chain = NULL; // 所有缓存组成的链表
+static kmem_cache *kmalloc_caches[KMALLOC_MAX_SHIFT + 1] = {0};
+static const char *kmalloc_names[KMALLOC_MAX_SHIFT + 1] = {
+    NULL, NULL, NULL, "kmalloc-8", "kmalloc-16", "kmalloc-32",
+    "kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+// 读取对象中保存的下一个空闲对象指针
+static inline void *get_free_ptr(const kmem_cache *cache, void *obj)
+{
+    return *(void **)(obj + cache->offset);
+}
+
+static inline void set_free_ptr(const kmem_cache *cache, void *obj, void *next)
+{
+    *(void **)(obj + cache->offset) = next;
+}
+
+// 将 slab 加入链表头部
+static void slab_list_add(page_frame **list, page_frame *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+    {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static void slab_list_del(page_frame **list, page_frame *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *list = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = slab->next = NULL;
+}
+
+// 计算容纳 count 字节所需的最小 2 的幂次
+static uint32_t size_to_shift(size_t size)
+{
+    uint32_t shift = 0;
+    while ((1U << shift) < size)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+/**
+ * 计算缓存的对象布局和 slab 大小
+ */
+static void cache_setup(kmem_cache *cache, const char *name, size_t size, size_t align, uint32_t flags, void (*ctor)(void *))
+{
+    if (flags & SLAB_HWCACHE_ALIGN)
+    {
+        align = MAX(align, CACHE_LINE_SIZE);
+    }
+    align = MAX(align, sizeof(void *));
+
+    memset(cache, 0, sizeof(kmem_cache));
+    cache->name = name;
+    cache->object_size = size;
+    cache->align = align;
+    cache->flags = flags;
+    cache->ctor = ctor;
+
+    // 有构造函数时，空闲对象的内容也要保持不变，所以空闲链表指针放在对象之后
+    size = ALIGN_UP(size, sizeof(void *));
+    cache->offset = ctor != NULL ? size : 0;
+    cache->size = ALIGN_UP(size + (ctor != NULL ? sizeof(void *) : 0), align);
+    assert(cache->size <= (PAGE_SIZE << SLAB_MAX_ORDER));
+
+    // 选择浪费空间不超过 1/8 的最小阶数
+    cache->order = 0;
+    while (cache->order < SLAB_MAX_ORDER &&
+           ((PAGE_SIZE << cache->order) % cache->size) * 8 > (PAGE_SIZE << cache->order))
+    {
+        cache->order++;
+    }
+    cache->objs_per_slab = (PAGE_SIZE << cache->order) / cache->size;
+}
+
+/**
+ * 为缓存申请一个新的 slab，构造所有对象并串成空闲链表
+ *
+ * @return slab 首页元数据，NULL 表示内存不足
+ */
+static page_frame *slab_grow(kmem_cache *cache)
+{
+    uint32_t addr = pmu_alloc_pages(cache->order);
+    if (addr == 0)
+    {
+        return NULL;
+    }
+
+    page_frame *slab = pmu_frame(addr);
+    for (uint32_t i = 0; i < (1U << cache->order); i++)
+    {
+        slab[i].flags |= PF_SLAB;
+        slab[i].slab_cache = cache;
+    }
+
+    // 从后向前串联，使空闲链表按地址递增，连续申请的对象在内存中相邻
+    slab->freelist = NULL;
+    for (uint32_t i = cache->objs_per_slab; i-- > 0;)
+    {
+        void *obj = (void *)addr + i * cache->size;
+        if (cache->ctor != NULL)
+        {
+            cache->ctor(obj);
+        }
+        set_free_ptr(cache, obj, slab->freelist);
+        slab->freelist = obj;
+    }
+    slab->inuse = 0;
+
+    cache->nr_slabs++;
+    cache->total_objs += cache->objs_per_slab;
+    return slab;
+}
+
+// 将空闲 slab 归还伙伴系统
+static void slab_destroy(kmem_cache *cache, page_frame *slab)
+{
+    assert(slab->inuse == 0);
+
+    for (uint32_t i = 0; i < (1U << cache->order); i++)
+    {
+        slab[i].flags &= ~PF_SLAB;
+        slab[i].slab_cache = NULL;
+    }
+    slab->freelist = NULL;
+    pmu_free_pages(pmu_frame_addr(slab), cache->order);
+
+    cache->nr_slabs--;
+    cache->total_objs -= cache->objs_per_slab;
+}
+
+// 所有缓存的空闲 slab 占用的页数
+static size_t slab_shrink_count(void)
+{
+    size_t pages = 0;
+    for (const kmem_cache *cache = cache_chain; cache != NULL; cache = cache->next)
+    {
+        pages += cache->nr_empty << cache->order;
+    }
+    return pages;
+}
+
+// 将空闲 slab 归还伙伴系统
+static size_t slab_shrink_scan(size_t nr)
+{
+    size_t freed = 0;
+    for (kmem_cache *cache = cache_chain; cache != NULL && freed < nr; cache = cache->next)
+    {
+        while (cache->empty != NULL && freed < nr)
+        {
+            page_frame *slab = cache->empty;
+            slab_list_del(&cache->empty, slab);
+            cache->nr_empty--;
+            slab_destroy(cache, slab);
+            freed += 1U << cache->order;
+        }
+    }
+    return freed;
+}
+
+static shrinker slab_shrinker = {
+    .name = "slab",
+    .count = slab_shrink_count,
+    .scan = slab_shrink_scan,
+};
+
+/**
+ * 创建对象缓存
+ *
+ * @param name 缓存名称，用于统计信息输出
+ * @param size 对象大小
+ * @param align 对象对齐，0 表示按指针大小对齐
+ * @param flags SLAB_*
+ * @param ctor 对象构造函数，可以为 NULL
+ * @return 缓存指针，NULL 表示失败
+ */
+kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align, uint32_t flags, void (*ctor)(void *))
+{
+    assert(size > 0);
+
+    kmem_cache *cache = kmem_cache_alloc(&cache_cache);
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    cache_setup(cache, name, size, align, flags, ctor);
+
+    cache->next = cache_chain;
+    cache_chain = cache;
+    return cache;
+}
+
+/**
+ * 从缓存中申请对象
+ *
+ * @return 对象指针，NULL 表示内存不足
+ */
+void *kmem_cache_alloc(kmem_cache *cache)
+{
+    page_frame *slab = cache->partial;
+    if (slab == NULL)
+    {
+        // 没有部分分配的 slab，优先复用空闲 slab，否则申请新的 slab
+        slab = cache->empty;
+        if (slab != NULL)
+        {
+            slab_list_del(&cache->empty, slab);
+            cache->nr_empty--;
+        }
+        else
+        {
+            slab = slab_grow(cache);
+            if (slab == NULL)
+            {
+                DEBUGK("%s: out of memory", cache->name);
+                return NULL;
+            }
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    void *obj = slab->freelist;
+    slab->freelist = get_free_ptr(cache, obj);
+    slab->inuse++;
+
+    if (slab->inuse == cache->objs_per_slab)
+    {
+        slab_list_del(&cache->partial, slab);
+        slab_list_add(&cache->full, slab);
+    }
+
+    cache->active_objs++;
+    cache->allocs++;
+    return obj;
+}
+
+/**
+ * 将对象释放回缓存
+ *
+ * 带构造函数的缓存要求对象已恢复为构造后的状态
+ */
+void kmem_cache_free(kmem_cache *cache, void *obj)
+{
+    if (obj == NULL)
+    {
+        return;
+    }
+
+    page_frame *slab = pmu_block_head(pmu_frame((uint32_t)obj), cache->order);
+    assert((slab->flags & PF_SLAB) && slab->slab_cache == cache);
+    assert(((uint32_t)obj - pmu_frame_addr(slab)) % cache->size == 0);
+
+    if (slab->inuse == cache->objs_per_slab)
+    {
+        slab_list_del(&cache->full, slab);
+        slab_list_add(&cache->partial, slab);
+    }
+
+    set_free_ptr(cache, obj, slab->freelist);
+    slab->freelist = obj;
+    slab->inuse--;
+
+    if (slab->inuse == 0)
+    {
+        slab_list_del(&cache->partial, slab);
+        if (cache->nr_empty < SLAB_MAX_EMPTY)
+        {
+            slab_list_add(&cache->empty, slab);
+            cache->nr_empty++;
+        }
+        else
+        {
+            slab_destroy(cache, slab);
+        }
+    }
+
+    cache->active_objs--;
+    cache->frees++;
+}
+
+/**
+ * 申请内存
+ *
+ * 不超过 2^KMALLOC_MAX_SHIFT 字节的申请从对应大小的 kmalloc 缓存中分配
+ * 更大的申请直接从伙伴系统申请连续页
+ *
+ * @return 内存地址，NULL 表示失败
+ */
+void *kmalloc(size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    uint32_t shift = MAX(size_to_shift(size), KMALLOC_MIN_SHIFT);
+    if (shift <= KMALLOC_MAX_SHIFT)
+    {
+        return kmem_cache_alloc(kmalloc_caches[shift]);
+    }
+
+    uint32_t order = size_to_shift(CEIL_DIV(size, PAGE_SIZE));
+    if (order >= PMU_MAX_ORDER)
+    {
+        return NULL;
+    }
+    return (void *)pmu_alloc_pages(order);
+}
+
+/**
+ * 释放 kmalloc 申请的内存
+ */
+void kfree(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    page_frame *frame = pmu_frame((uint32_t)ptr);
+    if (frame->flags & PF_SLAB)
+    {
+        kmem_cache_free(frame->slab_cache, ptr);
+        return;
+    }
+
+    // 直接从伙伴系统申请的内存，块阶数记录在首页中
+    assert(((uint32_t)ptr & 0xFFF) == 0);
+    pmu_free_pages((uint32_t)ptr, frame->order);
+}
+
+/**
+ * 输出所有缓存的统计信息
+ */
+void slab_info(void)
+{
+    printk("  active    total  objsize objs/slab pages/slab  slabs    allocs     frees name\n");
+    for (const kmem_cache *cache = cache_chain; cache != NULL; cache = cache->next)
+    {
+        printk("%8u %8u %8u %9u %10u %6u %9u %9u %s\n",
+               cache->active_objs, cache->total_objs, cache->size, cache->objs_per_slab,
+               1U << cache->order, cache->nr_slabs, cache->allocs, cache->frees, cache->name);
+    }
+}
+
+void slab_init(void)
+{
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache), 0, SLAB_HWCACHE_ALIGN, NULL);
+    cache_chain = &cache_cache;
+
+    // kmalloc 缓存按对象大小自然对齐
+    for (uint32_t shift = KMALLOC_MIN_SHIFT; shift <= KMALLOC_MAX_SHIFT; shift++)
+    {
+        kmalloc_caches[shift] = kmem_cache_create(kmalloc_names[shift], 1U << shift, 1U << shift, 0, NULL);
+        assert(kmalloc_caches[shift] != NULL);
+    }
+
+    register_shrinker(&slab_shrinker);
+}
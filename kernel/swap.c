@@ -0,0 +1,420 @@
+#include "kernel/swap.h"
+#include "kernel/zram.h"
+#include "kernel/ksm.h"
+#include "kernel/cpu.h"
+#include "kernel/pmu.h"
+#include "kernel/vmalloc.h"
+#include "kernel/tlb.h"
+#include "kernel/task.h"
+#include "kernel/ata.h"
+#include "kernel/mbr.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * 交换区与页面回收
+ *
+ * 换出的页优先压缩保存在内存中的 zram，页不可压缩或 zram 已满时写入交换分区
+ * 交换分区是磁盘上类型为 Linux swap 的分区，按页划分为槽位，槽位 0 保留不用
+ * 位图记录槽位是否已分配，便于按 32 位整块跳过已满的部分；引用计数记录共享槽位的页表项数量
+ * fork 时父子进程的换出页共享同一个槽位，所有页表项都换入或释放后槽位才空闲
+ *
+ * 物理内存耗尽时，pmu_alloc 调用 swap_reclaim 按 CLOCK（二次机会）算法回收用户页：
+ * 时钟指针依次扫描所有任务的用户页表，访问位为 1 的页清除访问位后跳过，给它第二次机会
+ * 访问位为 0 的页说明指针转过一圈期间没有被访问，将其回收
+ * - 未被写过（脏位为 0）的页内容与按需映射时相同，直接解除映射，再次访问时由 vma_fault 重新填充
+ * - 被写过的页写入 zram 或交换分区，页表项改为换出页，再次访问时由 swap_fault 读回
+ * 被多个进程共享的页（写时复制页、页缓存中的只读页）没有反向映射，无法修改所有页表项，不回收
+ *
+ * 没有交换分区时仍然可以使用 zram，并回收未写过的页
+ */
+
+#define PAGE_SECTS (PAGE_SIZE / SECT_SIZE) // 每页占用的扇区数
+
+static struct
+{
+    lba_t start_lba;  // 交换分区起始扇区
+    uint32_t slots;   // 槽位数量，0 表示没有交换区
+    uint32_t used;    // 已分配的槽位数量
+    uint32_t *bitmap; // 槽位分配位图
+    uint8_t *refs;    // 槽位引用计数
+    uint32_t hint;    // 下次开始查找空闲槽位的位图下标
+} swap = {0};
+
+// CLOCK 算法的时钟指针
+static struct
+{
+    uint32_t task; // 正在扫描的任务下标
+    uint32_t addr; // 下一个要扫描的线性地址，0 表示从用户空间开头开始
+} clock = {0};
+
+// 统计信息
+static struct
+{
+    uint32_t swap_outs; // 写入交换分区的页数
+    uint32_t swap_ins;  // 从交换分区读回的页数
+    uint32_t in_cycles; // 从交换分区读回耗费的 TSC 周期数
+    uint32_t zram_outs; // 保存到 zram 的页数
+    uint32_t zram_ins;  // 从 zram 读回的页数
+    uint32_t drops;     // 直接丢弃的未写过的页数
+} stats = {0};
+
+/**
+ * 分配交换槽位
+ *
+ * @return 槽位号，0 表示交换区已满或不存在
+ */
+static uint32_t slot_alloc(void)
+{
+    uint32_t words = CEIL_DIV(swap.slots, 32);
+    for (uint32_t n = 0; n < words; n++)
+    {
+        uint32_t i = (swap.hint + n) % words;
+        if (swap.bitmap[i] == 0xFFFFFFFF)
+        {
+            continue;
+        }
+        for (uint32_t bit = 0; bit < 32; bit++)
+        {
+            uint32_t slot = i * 32 + bit;
+            if (slot < swap.slots && !(swap.bitmap[i] & (1U << bit)))
+            {
+                swap.bitmap[i] |= 1U << bit;
+                swap.refs[slot] = 1;
+                swap.used++;
+                swap.hint = i;
+                return slot;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * 增加换出项的引用，fork 复制换出页的页表项时调用
+ */
+void swap_dup(uint32_t entry)
+{
+    if (entry & SWAP_ENTRY_ZRAM)
+    {
+        zram_dup(entry & ~SWAP_ENTRY_ZRAM);
+        return;
+    }
+    assert(entry > 0 && entry < swap.slots && swap.refs[entry] > 0);
+    // 引用计数为 8 位，共享同一页的进程数不会超过 NR_TASKS
+    swap.refs[entry]++;
+}
+
+/**
+ * 减少换出项的引用，没有引用时释放槽位
+ */
+void swap_free(uint32_t entry)
+{
+    if (entry & SWAP_ENTRY_ZRAM)
+    {
+        zram_free(entry & ~SWAP_ENTRY_ZRAM);
+        return;
+    }
+    assert(entry > 0 && entry < swap.slots && swap.refs[entry] > 0);
+    if (--swap.refs[entry] == 0)
+    {
+        swap.bitmap[entry / 32] &= ~(1U << (entry % 32));
+        swap.used--;
+    }
+}
+
+static inline lba_t slot_lba(uint32_t slot)
+{
+    return swap.start_lba + (lba_t)slot * PAGE_SECTS;
+}
+
+/**
+ * 保存被回收页的内容，优先压缩到 zram，其次写入交换分区
+ *
+ * @param adopted 输出，为 1 时页已被 zram 用作内存池，不能释放
+ * @return 换出项，0 表示无法保存
+ */
+static uint32_t swap_out(uint32_t page_addr, int *adopted)
+{
+    uint32_t id = zram_store(page_addr, adopted);
+    if (id != 0)
+    {
+        stats.zram_outs++;
+        return id | SWAP_ENTRY_ZRAM;
+    }
+
+    uint32_t slot = slot_alloc();
+    if (slot == 0)
+    {
+        return 0;
+    }
+    void *page = kmap(page_addr);
+    int err = ata_write(page, slot_lba(slot), PAGE_SECTS);
+    kunmap(page);
+    if (err != 0)
+    {
+        swap_free(slot);
+        return 0;
+    }
+    stats.swap_outs++;
+    return slot;
+}
+
+/**
+ * 尝试回收一个页表项映射的页
+ *
+ * @param batch 记录修改过的页表项，由调用者统一刷新 TLB
+ * @return 1 已回收，0 页最近被访问过或者无法回收
+ */
+static uint32_t reclaim_pte(task_struct *task, page_tabel_entry *pte, uint32_t addr, tlb_batch *batch)
+{
+    if (!pte->present)
+    {
+        return 0;
+    }
+
+    // 最近访问过的页获得第二次机会
+    if (pte->accessed)
+    {
+        pte->accessed = 0;
+        tlb_batch_add(batch, addr);
+        return 0;
+    }
+
+    uint32_t page_addr = pte->addr << 12;
+    if (pmu_page_shared(page_addr) || (pmu_frame(page_addr)->flags & PF_CACHED))
+    {
+        return 0;
+    }
+    // 只剩一个映射的合并页作为普通页回收
+    ksm_remove(page_addr);
+
+    int adopted = 0;
+    if (!pte->dirty && vma_find(&task->vmas, addr) != NULL)
+    {
+        // 未写过的页可以由缺页异常重新填充
+        memset(pte, 0, sizeof(page_tabel_entry));
+        stats.drops++;
+    }
+    else
+    {
+        uint32_t entry = swap_out(page_addr, &adopted);
+        if (entry == 0)
+        {
+            return 0;
+        }
+        pte->present = 0;
+        pte->avl |= PTE_AVL_SWAP;
+        pte->addr = entry;
+    }
+
+    tlb_batch_add(batch, addr);
+    if (!adopted)
+    {
+        pmu_page_put(page_addr);
+    }
+    return 1;
+}
+
+/**
+ * 从时钟指针处继续扫描任务的用户页表
+ *
+ * 回收到 count 页时停在下一页，扫描到地址空间末尾时指针回到开头
+ *
+ * @return 回收的页数
+ */
+static uint32_t reclaim_task(task_struct *task, uint32_t count)
+{
+    tlb_batch batch;
+    tlb_batch_init(&batch, task->page_dir);
+
+    uint32_t freed = 0;
+    uint32_t start = MAX(clock.addr, kernel_area_page_dir_end_index << 22);
+    for (uint32_t i = page_dir_index(start); i < 1024; i++)
+    {
+        const page_dir_entry *pde = &task->page_dir[i];
+        if (!pde->present || !pde->us)
+        {
+            continue;
+        }
+
+        page_tabel_entry *page_table = (page_tabel_entry *)(pde->addr << 12);
+        uint32_t j = i == page_dir_index(start) ? page_table_index(start) : 0;
+        for (; j < 1024; j++)
+        {
+            uint32_t addr = (i << 22) | (j << 12);
+            freed += reclaim_pte(task, &page_table[j], addr, &batch);
+            if (freed == count)
+            {
+                // 地址空间最后一页之后回绕为 0，正好表示下次从开头开始
+                clock.addr = addr + PAGE_SIZE;
+                tlb_batch_flush(&batch);
+                return freed;
+            }
+        }
+    }
+    clock.addr = 0;
+    tlb_batch_flush(&batch);
+    return freed;
+}
+
+/**
+ * 回收用户页，由 pmu_alloc 在物理内存耗尽时调用
+ *
+ * 时钟指针最多转两圈：第一圈清除的访问位在第二圈仍为 0 的页可以回收
+ *
+ * @param count 希望回收的页数
+ * @return 实际回收的页数
+ */
+uint32_t swap_reclaim(uint32_t count)
+{
+    uint32_t freed = 0;
+    for (uint32_t n = 0; n < 2 * NR_TASKS && freed < count; n++)
+    {
+        task_struct *task = task_at(clock.task);
+        // 跳过空位、已释放地址空间的僵尸进程和使用内核页目录的内核任务
+        if (task != NULL && task->page_dir != NULL && task->page_dir != get_kernel_page_dir())
+        {
+            freed += reclaim_task(task, count - freed);
+        }
+        else
+        {
+            clock.addr = 0;
+        }
+
+        if (clock.addr == 0)
+        {
+            clock.task = (clock.task + 1) % NR_TASKS;
+        }
+    }
+
+    DEBUGK("reclaimed %u pages", freed);
+    return freed;
+}
+
+/**
+ * 处理换出页的缺页异常，从交换区读回页并恢复页表项
+ *
+ * @param addr 触发异常的线性地址
+ * @return 0 处理成功，-1 不是换出页、内存不足或者读取失败
+ */
+int swap_fault(page_dir_entry *page_dir, uint32_t addr)
+{
+    page_tabel_entry *pte = get_page_table_entry(page_dir, addr);
+    if (pte == NULL || !pte_swapped(pte))
+    {
+        return -1;
+    }
+
+    // 申请页时可能回收其他页，但不会修改这个不存在的页表项
+    uint32_t entry = pte->addr;
+    uint32_t page_addr = pmu_alloc_user();
+    if (page_addr == 0)
+    {
+        return -1;
+    }
+    if (entry & SWAP_ENTRY_ZRAM)
+    {
+        if (zram_load(entry & ~SWAP_ENTRY_ZRAM, page_addr) != 0)
+        {
+            pmu_free(page_addr);
+            return -1;
+        }
+        stats.zram_ins++;
+    }
+    else
+    {
+        uint32_t start = cpu_has_feature(CPU_FEATURE_TSC) ? rdtsc() : 0;
+        void *page = kmap(page_addr);
+        int err = ata_read(page, slot_lba(entry), PAGE_SECTS);
+        kunmap(page);
+        if (err != 0)
+        {
+            pmu_free(page_addr);
+            return -1;
+        }
+        if (cpu_has_feature(CPU_FEATURE_TSC))
+        {
+            stats.in_cycles += rdtsc() - start;
+        }
+        stats.swap_ins++;
+    }
+    swap_free(entry);
+
+    // 槽位已释放，页的内容只存在于内存中，所以标记为已写过，回收时要重新写入交换区
+    pte->addr = page_addr >> 12;
+    pte->avl &= ~PTE_AVL_SWAP;
+    pte->accessed = 1;
+    pte->dirty = 1;
+    pte->present = 1;
+    return 0;
+}
+
+/**
+ * 输出交换区的统计信息
+ */
+void swap_info(void)
+{
+    printk("swap: %u/%u slots used, %u swap outs, %u swap ins (%u cycles each), %u clean drops\n",
+           swap.used, swap.slots > 0 ? swap.slots - 1 : 0, stats.swap_outs, stats.swap_ins,
+           stats.swap_ins > 0 ? stats.in_cycles / stats.swap_ins : 0, stats.drops);
+    printk("swap: %u zram outs, %u zram ins\n", stats.zram_outs, stats.zram_ins);
+    zram_info();
+}
+
+/**
+ * 查找交换分区并初始化槽位位图
+ *
+ * 使用 MBR 分区表中首个类型为 Linux swap 的分区，没有时只回收未写过的页
+ */
+void swap_init(void)
+{
+    static uint8_t buf[SECT_SIZE];
+    const mbr_struct *mbr = (const mbr_struct *)buf;
+
+    if (ata_read(buf, 0, 1) != 0)
+    {
+        return;
+    }
+
+    const partition_entry *part = NULL;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        if (mbr->partitions[i].partition_type == PART_TYPE_LINUX_SWAP)
+        {
+            part = &mbr->partitions[i];
+            break;
+        }
+    }
+    if (part == NULL || part->num_sectors < 2 * PAGE_SECTS)
+    {
+        DEBUGK("no swap partition");
+        return;
+    }
+
+    uint32_t slots = MIN(part->num_sectors / PAGE_SECTS, SWAP_MAX_SLOTS);
+    // 大交换分区的引用计数表可达数百 KiB，不需要物理连续
+    swap.bitmap = vmalloc(CEIL_DIV(slots, 32) * sizeof(uint32_t));
+    swap.refs = vmalloc(slots);
+    if (swap.bitmap == NULL || swap.refs == NULL)
+    {
+        vfree(swap.bitmap);
+        vfree(swap.refs);
+        swap.bitmap = NULL;
+        swap.refs = NULL;
+        DEBUGK("no memory for swap map");
+        return;
+    }
+    memset(swap.bitmap, 0, CEIL_DIV(slots, 32) * sizeof(uint32_t));
+    memset(swap.refs, 0, slots);
+
+    // 槽位 0 保留，槽位号为 0 表示分配失败
+    swap.bitmap[0] = 1;
+    swap.refs[0] = 1;
+    swap.start_lba = part->start_lba;
+    swap.slots = slots;
+
+    DEBUGK("swap: %u KiB at sector %u", (slots - 1) * (PAGE_SIZE / 1024), part->start_lba);
+}
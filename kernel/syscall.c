@@ -3,9 +3,20 @@
 #include "kernel/kernel.h"
 #include "kernel/tty.h"
 #include "kernel/scheduler.h"
-#include "kernel/task.h"
+#include "kernel/file.h"
+#include "kernel/slab.h"
+#include "kernel/vmalloc.h"
+#include "kernel/pagecache.h"
+#include "kernel/ksm.h"
+#include "kernel/swap.h"
+#include "kernel/tlb.h"
+#include "kernel/reclaim.h"
+#include "kernel/reaper.h"
+#include "kernel/page.h"
 #include "waitflags.h"
+#include "advice.h"
 #include "stdio.h"
+#include "algobase.h"
 
 static void* syscall_table[NR_SYSCALL];
 
@@ -34,6 +45,10 @@ static int sys_write(uint32_t fd, const void *buf, uint32_t count)
 static int sys_fork(void)
 {
     task_struct *new_task = fork_task(running_task(1));
+    if (new_task == NULL)
+    {
+        return -1;
+    }
 
     // 新进程的 fork() 返回值是 0
     new_task->interrupt_frame->eax = 0;
@@ -68,6 +83,15 @@ static void sys_exit(int exit_code)
     panic("sys_exit: no task to switch");
 }
 
+/**
+ * 阻塞当前任务，直到有子进程结束时由 task_exit 唤醒
+ */
+static void wait_for_child(task_struct *task)
+{
+    switch_task_state(task, TASK_BLOCKED);
+    schedule();
+}
+
 static pid_t sys_wait(int *status)
 {
     task_struct *task = running_task(1);
@@ -96,8 +120,8 @@ static pid_t sys_wait(int *status)
             break;
         }
 
-        // 调度其他任务
-        schedule();
+        // 阻塞等待子进程结束
+        wait_for_child(task);
     }
 
     // 记录返回值
@@ -155,8 +179,8 @@ static pid_t sys_waitpid(pid_t pid, int *status, int options)
             {
                 return 0;
             }
-            // 调度其他任务
-            schedule();
+            // 阻塞等待子进程结束
+            wait_for_child(task);
         }
     }
     // 等待指定进程结束
@@ -183,8 +207,8 @@ static pid_t sys_waitpid(pid_t pid, int *status, int options)
         // 阻塞等待
         while(child->state != TASK_ZOMBIE)
         {
-            // 调度其他任务
-            schedule();
+            // 阻塞等待子进程结束
+            wait_for_child(task);
         }
     }
 
@@ -206,6 +230,27 @@ static pid_t sys_waitpid(pid_t pid, int *status, int options)
     return pid;
 }
 
+/**
+ * 从可执行文件创建子进程，代替 fork 后立即 execl 的组合
+ *
+ * 不复制父进程的地址空间，父进程也不需要等待
+ *
+ * @return 子进程 pid，-1 表示失败
+ */
+static pid_t sys_spawnl(const char *file_path, va_list args)
+{
+    task_struct *new_task = spawn_task(file_path, running_task(1));
+    if (new_task == NULL)
+    {
+        return -1;
+    }
+
+    // 将新进程加入调度队列
+    switch_task_state(new_task, TASK_READY);
+
+    return new_task->pid;
+}
+
 static int sys_execl(const char *file_path, va_list args)
 {
     struct task_struct *task = running_task(1);
@@ -224,6 +269,142 @@ static int sys_execl(const char *file_path, va_list args)
     return 0;
 }
 
+/**
+ * 获取文件描述符对应的打开文件
+ *
+ * @return 打开文件，NULL 表示文件描述符无效
+ */
+static open_file *get_open_file(task_struct *task, int fd)
+{
+    if (fd < 0 || fd >= NR_OPEN)
+    {
+        return NULL;
+    }
+    return task->files[fd];
+}
+
+static int sys_open(const char *path)
+{
+    task_struct *task = running_task(1);
+
+    // 分配最小的空闲文件描述符，0~2 保留给标准输入输出
+    for (int fd = STDERR + 1; fd < NR_OPEN; fd++)
+    {
+        if (task->files[fd] != NULL)
+        {
+            continue;
+        }
+        open_file *f = open_file_create(path);
+        if (f == NULL)
+        {
+            return -1;
+        }
+        task->files[fd] = f;
+        return fd;
+    }
+    return -1;
+}
+
+/**
+ * 检查用户缓冲区是否完整位于用户空间，且不会回绕
+ *
+ * 内核以自己的权限写入缓冲区，不检查时用户可以借系统调用改写内核内存
+ */
+static int user_range_ok(const void *buf, size_t count)
+{
+    uint32_t start = (uint32_t)buf;
+    return start >= KERNEL_SPACE_END && start + count >= start;
+}
+
+static int sys_read(int fd, void *buf, size_t count)
+{
+    open_file *f = get_open_file(running_task(1), fd);
+    if (f == NULL || !user_range_ok(buf, count))
+    {
+        return -1;
+    }
+    return open_file_read(f, buf, count);
+}
+
+static int sys_close(int fd)
+{
+    task_struct *task = running_task(1);
+    open_file *f = get_open_file(task, fd);
+    if (f == NULL)
+    {
+        return -1;
+    }
+    task->files[fd] = NULL;
+    open_file_put(f);
+    return 0;
+}
+
+static int sys_fadvise(int fd, off_t offset, size_t len, int advice)
+{
+    open_file *f = get_open_file(running_task(1), fd);
+    if (f == NULL)
+    {
+        return -1;
+    }
+    return open_file_advise(f, offset, len, advice);
+}
+
+static int sys_madvise(void *addr, size_t len, int advice)
+{
+    task_struct *task = running_task(1);
+    return vma_advise(task->page_dir, &task->vmas, (uint32_t)addr, len, advice);
+}
+
+/**
+ * 设置堆的结束地址
+ *
+ * 堆的页在首次访问时才映射为全 0 的页，缩小堆时释放超出部分的页
+ *
+ * @param addr 新的结束地址，0 表示只查询
+ * @return 调整后的结束地址，失败时返回原结束地址
+ */
+static uint32_t sys_brk(uint32_t addr)
+{
+    task_struct *task = running_task(1);
+
+    if (addr < task->brk_start || addr > USER_HEAP_LIMIT)
+    {
+        return task->brk;
+    }
+
+    uint32_t old_end = ALIGN_UP(task->brk, PAGE_SIZE);
+    uint32_t new_end = ALIGN_UP(addr, PAGE_SIZE);
+    if (vma_brk(task->page_dir, &task->vmas, task->brk_start, old_end, new_end) != 0)
+    {
+        return task->brk;
+    }
+
+    task->brk = addr;
+    return task->brk;
+}
+
+static int sys_meminfo(void)
+{
+    page_info();
+    tlb_info();
+    pmu_info();
+    slab_info();
+    vmalloc_info();
+    page_cache_info();
+    ksm_info();
+    swap_info();
+    reclaim_info();
+    reaper_info();
+    return 0;
+}
+
+static int sys_yield(void)
+{
+    // 当前任务放回就绪队列末尾，调度其他任务
+    schedule();
+    return 0;
+}
+
 void syscall_handler(uint32_t syscall_no, uint32_t arg1, uint32_t arg2, uint32_t arg3, interrupt_frame *frame)
 {
     /**
@@ -248,7 +429,11 @@ void syscall_handler(uint32_t syscall_no, uint32_t arg1, uint32_t arg2, uint32_t
     }
 
     // 调用对应系统调用函数，返回值保存在 eax 寄存器
-    frame->eax = ((int(*)(uint32_t, uint32_t, uint32_t))syscall_table[syscall_no])(arg1, arg2, arg3);
+    // 第 4 个参数通过 esi 寄存器传递，从中断栈帧中取出
+    frame->eax = ((int(*)(uint32_t, uint32_t, uint32_t, uint32_t))syscall_table[syscall_no])(arg1, arg2, arg3, frame->esi);
+
+    // 系统调用中申请内存失败时当前任务可能被选中结束，此时已经撤销了未完成的操作
+    oom_check();
 }
 
 void syscall_init(void)
@@ -265,4 +450,13 @@ void syscall_init(void)
     syscall_table[SYS_NR_WAIT] = sys_wait;
     syscall_table[SYS_NR_WAITPID] = sys_waitpid;
     syscall_table[SYS_NR_EXECL] = sys_execl;
+    syscall_table[SYS_NR_OPEN] = sys_open;
+    syscall_table[SYS_NR_READ] = sys_read;
+    syscall_table[SYS_NR_CLOSE] = sys_close;
+    syscall_table[SYS_NR_FADVISE] = sys_fadvise;
+    syscall_table[SYS_NR_MADVISE] = sys_madvise;
+    syscall_table[SYS_NR_MEMINFO] = sys_meminfo;
+    syscall_table[SYS_NR_YIELD] = sys_yield;
+    syscall_table[SYS_NR_SPAWN] = sys_spawnl;
+    syscall_table[SYS_NR_BRK] = sys_brk;
 }
\ No newline at end of file
@@ -1,76 +1,131 @@
 #include "kernel/task.h"
 #include "kernel/pmu.h"
+#include "kernel/slab.h"
 #include "kernel/kernel.h"
 #include "kernel/elf.h"
 #include "kernel/pic.h"
 #include "kernel/x86.h"
 #include "kernel/scheduler.h"
+#include "kernel/reclaim.h"
+#include "kernel/reaper.h"
+#include "algobase.h"
 #include "string.h"
 
-static uint8_t is_used[NR_TASKS] = {0};
-static task_union task_unions[NR_TASKS] __attribute__((aligned(PAGE_SIZE))) = {0};
+static kmem_cache *task_cache = NULL; // task_union 对象缓存
+static uint32_t nr_tasks = 0;         // 已创建的任务数量
 static task_struct *init_task = NULL;
+static pid_t next_pid = INIT_PID;     // 下一个任务的 pid
+static task_struct *task_table[NR_TASKS] = {0}; // 所有未释放的任务，空位为 NULL
 
 static task_union* get_free_task_union(void)
 {
-    for (int i = 0; i < NR_TASKS; i++)
+    if (nr_tasks >= NR_TASKS)
     {
-        if (is_used[i] == 0)
-        {
-            is_used[i] = 1;
-            return &task_unions[i];
-        }
+        DEBUGK("no free task union");
+        return NULL;
+    }
+
+    task_union *ptr = kmem_cache_alloc(task_cache);
+    if (ptr == NULL)
+    {
+        DEBUGK("no free task union");
+        return NULL;
+    }
+    // 任务数量不超过 NR_TASKS，一定有空位
+    uint32_t i = 0;
+    while (task_table[i] != NULL)
+    {
+        i++;
     }
-    DEBUGK("no free task union");
-    return NULL;
+    task_table[i] = &ptr->task;
+    nr_tasks++;
+    return ptr;
 }
 
-static int set_free_task_union(task_union *ptr)
+static void set_free_task_union(task_union *ptr)
 {
-    // FIXME: 可以不用循环查找，而是直接通过地址计算出索引
-    for (int i = 0; i < NR_TASKS; i++)
+    for (uint32_t i = 0; i < NR_TASKS; i++)
     {
-        if (ptr == &task_unions[i])
+        if (task_table[i] == &ptr->task)
         {
-            if (is_used[i] == 0)
-            {
-                DEBUGK("task union is already free");
-                return -1;
-            }
-            is_used[i] = 0;
-            return 0;
+            task_table[i] = NULL;
+            break;
         }
     }
-    DEBUGK("invalid task union");
-    return -1;
+    kmem_cache_free(task_cache, ptr);
+    nr_tasks--;
 }
 
-static void init_task_stack(task_union *task_union, uint32_t entry)
+/**
+ * 初始化中断栈帧的位置
+ *
+ * NOTE: 不能将中断栈帧指向 kernel_stack 的开始处，
+ *       因为这是一个 union，修改 kernel_stack 前面的部分会覆盖 task 结构体
+ */
+static void init_task_frame(task_union *task_union)
 {
-    // 初始化进程用户态栈
-    uint32_t stack_page = pmu_alloc();
-    uint32_t maped_usr_stack_top = PAGE_SIZE + map_physical_page(task_union->task.page_dir, stack_page, 1, 1);
-    // 初始化中断栈帧，模拟中断调用
-    // NOTE: 不能将中断栈帧指向 kernel_stack 的开始处，
-    //       因为这是一个 union，修改 kernel_stack 前面的部分会覆盖 task 结构体
     task_union->task.interrupt_frame = (interrupt_frame *)(task_union->kernel_stack + PAGE_SIZE - sizeof(interrupt_frame));
     memset(task_union->task.interrupt_frame, 0, sizeof(interrupt_frame));
-    task_union->task.interrupt_frame->ss = USER_DATA_SELECTOR;
-    task_union->task.interrupt_frame->esp = maped_usr_stack_top;
-    task_union->task.interrupt_frame->eflags = get_eflags();
-    task_union->task.interrupt_frame->cs = USER_CODE_SELECTOR;
-    task_union->task.interrupt_frame->eip = entry;
-    task_union->task.interrupt_frame->es = USER_DATA_SELECTOR;
-    task_union->task.interrupt_frame->ds = USER_DATA_SELECTOR;
-    task_union->task.interrupt_frame->fs = USER_DATA_SELECTOR;
-    task_union->task.interrupt_frame->gs = USER_DATA_SELECTOR;
 }
 
-static task_struct* create_task(uint32_t entry, page_dir_entry *page_dir, task_struct *parent)
+/**
+ * 添加用户态栈区域
+ *
+ * 区域初始只有栈顶的一页，并且不预先映射，访问栈顶下方的地址时由缺页异常向下扩展
+ * 栈的实际大小受任务的 stack_limit 限制，最多使用栈顶下方 USER_STACK_SIZE 的范围
+ *
+ * @return 0 成功，-1 内存不足
+ */
+static int add_stack_vma(vm_map *vmas)
 {
-    assert(page_dir != NULL);
+    return vma_add(vmas, USER_STACK_TOP - PAGE_SIZE, USER_STACK_TOP, VM_READ | VM_WRITE | VM_GROWSDOWN,
+                   NULL, 0, 0, 0);
+}
+
+/**
+ * 设置中断栈帧从程序入口开始执行，栈指针指向用户态栈顶
+ */
+static void init_task_stack(task_struct *task, uint32_t entry)
+{
+    // 初始化中断栈帧，模拟中断调用
+    memset(task->interrupt_frame, 0, sizeof(interrupt_frame));
+    task->interrupt_frame->ss = USER_DATA_SELECTOR;
+    task->interrupt_frame->esp = USER_STACK_TOP;
+    // 在系统调用中创建任务时中断是关闭的，要确保任务在用户态开启中断
+    task->interrupt_frame->eflags = get_eflags() | EFLAGS_IF;
+    task->interrupt_frame->cs = USER_CODE_SELECTOR;
+    task->interrupt_frame->eip = entry;
+    task->interrupt_frame->es = USER_DATA_SELECTOR;
+    task->interrupt_frame->ds = USER_DATA_SELECTOR;
+    task->interrupt_frame->fs = USER_DATA_SELECTOR;
+    task->interrupt_frame->gs = USER_DATA_SELECTOR;
+}
+
+/**
+ * 初始化堆，堆从最后一个程序段之后开始，初始大小为 0
+ */
+static void init_task_brk(task_struct *task)
+{
+    task->brk_start = KERNEL_SPACE_END;
+    for (vm_area *vma = task->vmas.head; vma != NULL; vma = vma->next)
+    {
+        if (!(vma->flags & VM_GROWSDOWN))
+        {
+            task->brk_start = MAX(task->brk_start, vma->end);
+        }
+    }
+    task->brk = task->brk_start;
+}
+
+/**
+ * 创建用户任务，调用者负责设置中断栈帧的内容
+ *
+ * @param vmas 地址空间区域，由任务接管
+ */
 
-    static int _pid = INIT_PID;
+static task_struct* create_task(page_dir_entry *page_dir, vm_map *vmas, task_struct *parent)
+{
+    assert(page_dir != NULL);
 
     task_union* task_union = get_free_task_union();
     if (task_union == NULL)
@@ -79,6 +134,9 @@ static task_struct* create_task(uint32_t entry, page_dir_entry *page_dir, task_s
         return NULL;
     }
 
+    // 缓存中的对象可能是之前释放的任务，要先清空
+    memset(&task_union->task, 0, sizeof(task_struct));
+
     // 设置父子、兄弟关系
     task_union->task.child = NULL;
     task_union->task.parent = parent;
@@ -88,16 +146,54 @@ static task_struct* create_task(uint32_t entry, page_dir_entry *page_dir, task_s
         parent->child = &task_union->task;
     }
     // 设置独特的 pid
-    task_union->task.pid = _pid++;
+    task_union->task.pid = next_pid++;
     // 进程状态
     task_union->task.state = TASK_NONE;
     // 初始化 TSS ，设置内核态栈
     task_union->task.tss.ss0 = KER_DATA_SELECTOR;
     task_union->task.tss.esp0 = (uint32_t)&task_union->kernel_stack[PAGE_SIZE];
-    // 初始化进程页目录
+    // 初始化进程页目录和地址空间区域
     task_union->task.page_dir = page_dir;
-    // 初始化进程用户态栈和中断栈帧
-    init_task_stack(task_union, entry);
+    task_union->task.vmas = *vmas;
+    // 初始化中断栈帧
+    init_task_frame(task_union);
+
+    return &task_union->task;
+}
+
+/**
+ * 创建内核任务
+ *
+ * 内核任务运行在特权级 0，使用内核页目录，没有用户态栈
+ * 中断返回时不切换特权级，iret 不会弹出 esp 和 ss，所以直接使用 task_union 中的内核栈
+ *
+ * @param entry 任务入口函数，不能返回
+ * @return 任务指针，NULL 表示失败
+ */
+task_struct* create_kernel_task(void (*entry)(void))
+{
+    task_union *task_union = get_free_task_union();
+    if (task_union == NULL)
+    {
+        DEBUGK("create kernel task failed");
+        return NULL;
+    }
+
+    memset(&task_union->task, 0, sizeof(task_struct));
+    task_union->task.pid = next_pid++;
+    task_union->task.state = TASK_NONE;
+    task_union->task.tss.ss0 = KER_DATA_SELECTOR;
+    task_union->task.tss.esp0 = (uint32_t)&task_union->kernel_stack[PAGE_SIZE];
+    task_union->task.page_dir = get_kernel_page_dir();
+
+    init_task_frame(task_union);
+    task_union->task.interrupt_frame->eflags = get_eflags() | EFLAGS_IF;
+    task_union->task.interrupt_frame->cs = KER_CODE_SELECTOR;
+    task_union->task.interrupt_frame->eip = (uint32_t)entry;
+    task_union->task.interrupt_frame->es = KER_DATA_SELECTOR;
+    task_union->task.interrupt_frame->ds = KER_DATA_SELECTOR;
+    task_union->task.interrupt_frame->fs = KER_DATA_SELECTOR;
+    task_union->task.interrupt_frame->gs = KER_DATA_SELECTOR;
 
     return &task_union->task;
 }
@@ -106,38 +202,54 @@ static task_struct* create_task(uint32_t entry, page_dir_entry *page_dir, task_s
  * 释放申请的内存资源
  * 
  * 由于程序使用的内存页都映射到了页目录中
- * 所以只要释放整个页目录映射的内存与页目录本身
- * 不需要额外释放栈页
+ * 所以只要释放整个页目录映射的内存与页目录本身，以及记录地址空间的区域
+ * 栈也是其中的一个区域，不需要额外释放栈页
+ * 释放由后台释放任务在之后完成，退出和 exec 不需要等待
  */
 static void free_task_alloced_memory(task_struct *task)
 {
     assert(task != NULL);
 
-    free_user_page_dir(task->page_dir);
+    reaper_defer(task->page_dir, &task->vmas);
     task->page_dir = NULL;
 }
 
 task_struct* create_task_from_elf(const char *file_path, task_struct *parent)
 {
-    // 创建页目录
-    page_dir_entry* page_dir = create_user_page_dir();
-
-    // 加载 ELF 文件，读取程序数据到内存，并获取程序入口
-    uint32_t entry = elf_loader(page_dir, file_path);
+    // 加载 ELF 文件，记录程序段的区域，并获取程序入口
+    vm_map vmas = {0};
+    uint32_t entry = elf_loader(&vmas, file_path);
     if (entry == 0)
     {
         DEBUGK("load ELF file failed");
-        free_user_page_dir(page_dir);
         return NULL;
     }
-    
+    if (add_stack_vma(&vmas) != 0)
+    {
+        vma_free(&vmas);
+        return NULL;
+    }
+
+    // 创建页目录，程序段的页在首次访问时才映射
+    page_dir_entry* page_dir = create_user_page_dir();
+    if (page_dir == NULL)
+    {
+        vma_free(&vmas);
+        return NULL;
+    }
+
     // 创建进程
-    task_struct* task = create_task(entry, page_dir, parent);
+    task_struct* task = create_task(page_dir, &vmas, parent);
     if (task == NULL)
     {
         free_user_page_dir(page_dir);
+        vma_free(&vmas);
         return NULL;
     }
+    // 初始化进程用户态栈、堆和中断栈帧，栈大小上限继承自父进程
+    init_task_stack(task, entry);
+    init_task_brk(task);
+    task->stack_limit = parent != NULL ? parent->stack_limit : USER_STACK_SIZE;
 
     return task;
 }
@@ -147,33 +259,63 @@ int reload_task_from_elf(const char *file_path, task_struct *task)
     assert(task != NULL);
     assert(file_path != NULL);
 
-    // 新建页目录
-    page_dir_entry* page_dir = create_user_page_dir();
-
-    // 加载 ELF 文件，读取程序数据到内存，并获取程序入口
-    uint32_t entry = elf_loader(page_dir, file_path);
+    // 加载 ELF 文件，记录程序段的区域，并获取程序入口
+    // NOTE: file_path 位于原有的地址空间中，加载完成前不能释放
+    vm_map vmas = {0};
+    uint32_t entry = elf_loader(&vmas, file_path);
     if (entry == 0)
     {
         DEBUGK("load ELF file failed");
-        free_user_page_dir(page_dir);
+        return -1;
+    }
+    if (add_stack_vma(&vmas) != 0)
+    {
+        vma_free(&vmas);
         return -1;
     }
 
-    // 释放原有的页目录
-    free_user_page_dir(task->page_dir);
+    // 先创建新的页目录，失败时原有的地址空间保持不变
+    page_dir_entry *page_dir = create_user_page_dir();
+    if (page_dir == NULL)
+    {
+        vma_free(&vmas);
+        return -1;
+    }
+
+    // 释放原有的页目录和区域，替换为新的地址空间
+    free_task_alloced_memory(task);
     task->page_dir = page_dir;
+    task->vmas = vmas;
 
-    // 重置栈和中断栈帧，设置任务返回地址
-    init_task_stack((task_union *)task, entry);
+    // 重置栈、堆和中断栈帧，设置任务返回地址，栈大小上限保持不变
+    init_task_stack(task, entry);
+    init_task_brk(task);
 
     return 0;
 }
 
+// 继承打开的文件，与父进程共享读写位置
+static void inherit_files(task_struct *task, task_struct *parent)
+{
+    for (int fd = 0; fd < NR_OPEN; fd++)
+    {
+        if (parent->files[fd] != NULL)
+        {
+            open_file_get(parent->files[fd]);
+            task->files[fd] = parent->files[fd];
+        }
+    }
+}
+
 task_struct* fork_task(task_struct *parent)
 {
     assert(parent != NULL);
 
     page_dir_entry *page_dir = create_user_page_dir();
+    if (page_dir == NULL)
+    {
+        return NULL;
+    }
     // 拷贝页目录与内存数据
     if(copy_page_dir_and_memory(page_dir, parent->page_dir) < 0)
     {
@@ -182,16 +324,54 @@ task_struct* fork_task(task_struct *parent)
         return NULL;
     }
     
+    // 复制地址空间区域，未映射的页由子进程自己按需读取
+    vm_map vmas = {0};
+    if (vma_copy(&vmas, &parent->vmas) < 0)
+    {
+        DEBUGK("copy task failed");
+        free_user_page_dir(page_dir);
+        return NULL;
+    }
+
     // 创建新任务
-    task_struct* new_task = create_task(0, page_dir, parent);
+    task_struct* new_task = create_task(page_dir, &vmas, parent);
     if (new_task == NULL)
     {
         free_user_page_dir(page_dir);
+        vma_free(&vmas);
         return NULL;
     }
 
     // 拷贝中断上下文，得到返回地址，栈顶指针等信息
     *new_task->interrupt_frame = *parent->interrupt_frame;
+    // 堆区域已随地址空间区域复制
+    new_task->brk_start = parent->brk_start;
+    new_task->brk = parent->brk;
+    new_task->stack_limit = parent->stack_limit;
+
+    inherit_files(new_task, parent);
+
+    return new_task;
+}
+
+/**
+ * 直接从 ELF 文件创建子进程，相当于 fork 之后立即 exec
+ *
+ * 不复制父进程的页目录，子进程只继承打开的文件
+ *
+ * @return 子进程，NULL 表示失败
+ */
+task_struct* spawn_task(const char *file_path, task_struct *parent)
+{
+    assert(parent != NULL);
+
+    task_struct *new_task = create_task_from_elf(file_path, parent);
+    if (new_task == NULL)
+    {
+        return NULL;
+    }
+
+    inherit_files(new_task, parent);
 
     return new_task;
 }
@@ -216,6 +396,16 @@ void task_exit(task_struct *task, int exit_code)
     // 释放申请的内存资源
     free_task_alloced_memory(task);
 
+    // 关闭打开的文件
+    for (int fd = 0; fd < NR_OPEN; fd++)
+    {
+        if (task->files[fd] != NULL)
+        {
+            open_file_put(task->files[fd]);
+            task->files[fd] = NULL;
+        }
+    }
+
     // 子进程变为孤儿进程, 由 init 进程接管
     task_struct *last_child = NULL;
     for (task_struct *child = task->child; child != NULL; child = child->sibling) 
@@ -228,9 +418,34 @@ void task_exit(task_struct *task, int exit_code)
     {
         last_child->sibling = init_task->child;
         init_task->child = task->child;
+        task->child = NULL;
+
+        // 接管的子进程中可能有僵尸进程，唤醒 init 进程回收
+        if (init_task->state == TASK_BLOCKED)
+        {
+            switch_task_state(init_task, TASK_READY);
+        }
+    }
+
+    // 唤醒等待子进程退出的父进程
+    if (task->parent != NULL && task->parent->state == TASK_BLOCKED)
+    {
+        switch_task_state(task->parent, TASK_READY);
     }
 }
 
+/**
+ * 按下标获取任务，用于遍历所有任务
+ *
+ * @param index 小于 NR_TASKS
+ * @return 任务，NULL 表示空位
+ */
+task_struct *task_at(uint32_t index)
+{
+    assert(index < NR_TASKS);
+    return task_table[index];
+}
+
 void task_dead(task_struct *task)
 {
     assert(task != NULL);
@@ -241,6 +456,10 @@ void task_dead(task_struct *task)
 
 void task_init(void)
 {
+    // task_union 恰好占用一页，按页对齐后每个对象独占一个物理页
+    task_cache = kmem_cache_create("task_union", sizeof(task_union), PAGE_SIZE, 0, NULL);
+    assert(task_cache != NULL);
+
     // 创建首个任务
     init_task = create_task_from_elf("/bin/init", NULL);
 
@@ -248,6 +467,10 @@ void task_init(void)
     {
         panic("create init task failed");
     }
+
+    // 创建后台回收任务和地址空间释放任务
+    reclaim_init();
+    reaper_init();
     
     // 初始化调度器
     scheduler_init(init_task);
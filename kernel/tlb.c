@@ -0,0 +1,132 @@
+#include "kernel/tlb.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+
+/**
+ * TLB 管理
+ *
+ * 修改已存在的页表项（解除映射、写保护、清除访问位）后，TLB 中可能还缓存着旧的条目，要使其失效
+ * 只有页目录是当前使用的页目录时才需要处理：其他页目录的非全局条目在切换 CR3 时已经清空
+ * 把不存在的页表项改为存在不需要刷新，CPU 不会缓存不存在的条目
+ *
+ * 失效少量页时逐页执行 invlpg，只清除对应的条目
+ * 页数较多时重新加载 CR3 更快，代价是清空所有非全局条目（内核的恒等映射是全局页，不受影响）
+ *
+ * 批量刷新时页可能在刷新之前就已经释放，这在单处理器上是安全的：
+ * 批量刷新期间中断关闭，不会执行用户代码，内核也不会通过用户地址访问这些页
+ */
+
+// 统计信息
+static struct
+{
+    uint32_t pages;   // invlpg 失效的页数
+    uint32_t full;    // 重新加载 CR3 的次数
+    uint32_t batches; // 批量刷新的次数
+} stats = {0};
+
+static inline int is_current(const page_dir_entry *page_dir)
+{
+    return get_cr3() == (uint32_t)page_dir;
+}
+
+/**
+ * 重新加载 CR3，清空所有非全局页的 TLB 条目
+ */
+void tlb_flush_all(void)
+{
+    set_cr3(get_cr3());
+    stats.full++;
+}
+
+/**
+ * 使一页的 TLB 条目失效，页目录不是当前页目录时不做任何处理
+ */
+void tlb_flush_page(const page_dir_entry *page_dir, uint32_t addr)
+{
+    if (is_current(page_dir))
+    {
+        invlpg(ALIGN_DOWN(addr, PAGE_SIZE));
+        stats.pages++;
+    }
+}
+
+/**
+ * 使 [start, end) 范围内的 TLB 条目失效，超过 TLB_FLUSH_THRESHOLD 页时清空整个 TLB
+ */
+void tlb_flush_range(const page_dir_entry *page_dir, uint32_t start, uint32_t end)
+{
+    if (!is_current(page_dir) || start >= end)
+    {
+        return;
+    }
+
+    start = ALIGN_DOWN(start, PAGE_SIZE);
+    if ((end - start + PAGE_SIZE - 1) / PAGE_SIZE > TLB_FLUSH_THRESHOLD)
+    {
+        tlb_flush_all();
+        return;
+    }
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE)
+    {
+        invlpg(addr);
+        stats.pages++;
+    }
+}
+
+void tlb_batch_init(tlb_batch *batch, const page_dir_entry *page_dir)
+{
+    batch->page_dir = page_dir;
+    batch->count = 0;
+}
+
+/**
+ * 记录需要失效的页，页目录不是当前页目录时不记录
+ */
+void tlb_batch_add(tlb_batch *batch, uint32_t addr)
+{
+    if (!is_current(batch->page_dir))
+    {
+        return;
+    }
+    // 超过阈值后只计数，刷新时清空整个 TLB
+    if (batch->count < TLB_FLUSH_THRESHOLD)
+    {
+        batch->addrs[batch->count] = ALIGN_DOWN(addr, PAGE_SIZE);
+    }
+    batch->count++;
+}
+
+/**
+ * 刷新记录的页，之后批次可以继续使用
+ */
+void tlb_batch_flush(tlb_batch *batch)
+{
+    if (batch->count == 0)
+    {
+        return;
+    }
+
+    if (batch->count > TLB_FLUSH_THRESHOLD)
+    {
+        tlb_flush_all();
+    }
+    else
+    {
+        for (uint32_t i = 0; i < batch->count; i++)
+        {
+            invlpg(batch->addrs[i]);
+        }
+        stats.pages += batch->count;
+    }
+    stats.batches++;
+    batch->count = 0;
+}
+
+/**
+ * 输出 TLB 刷新的统计信息
+ */
+void tlb_info(void)
+{
+    printk("tlb: %u pages invalidated, %u full flushes, %u batches\n", stats.pages, stats.full, stats.batches);
+}
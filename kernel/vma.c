@@ -0,0 +1,562 @@
+#include "kernel/vma.h"
+#include "kernel/pmu.h"
+#include "kernel/pagecache.h"
+#include "kernel/slab.h"
+#include "kernel/tlb.h"
+#include "kernel/kernel.h"
+#include "advice.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * 用户地址空间区域
+ *
+ * 加载程序时只记录各个段所在的区域，不申请内存也不读取文件
+ * 首次访问区域内的页时触发缺页异常，由 vma_fault 申请页并从文件读取数据，不属于文件的部分保持为 0
+ * 所以启动耗时和常驻内存只与实际访问到的页数有关，与程序大小无关
+ * 只读区域的文件页通过页缓存在进程间共享，可写区域的页始终是进程私有的（fork 后写时复制）
+ *
+ * 每次缺页异常和回收都要按地址查找区域，所以区域除了链表之外还组成以起始地址为键的 AVL 树
+ * 区域互不重叠，按起始地址排序也就是按结束地址排序，查找包含地址的区域只需沿树下降一次
+ * 区域的范围变化时不会越过相邻区域，在树中的位置不变，不需要调整树
+ */
+
+static kmem_cache *vma_cache = NULL; // vm_area 对象缓存
+
+static inline uint32_t tree_height(const vm_area *node)
+{
+    return node != NULL ? node->height : 0;
+}
+
+// 根据子树重新计算节点的高度
+static void tree_update(vm_area *node)
+{
+    node->height = MAX(tree_height(node->left), tree_height(node->right)) + 1;
+}
+
+static vm_area *rotate_left(vm_area *node)
+{
+    vm_area *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    tree_update(node);
+    tree_update(right);
+    return right;
+}
+
+static vm_area *rotate_right(vm_area *node)
+{
+    vm_area *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    tree_update(node);
+    tree_update(left);
+    return left;
+}
+
+/**
+ * 更新节点，左右子树高度差超过 1 时旋转
+ *
+ * @return 子树新的根
+ */
+static vm_area *tree_balance(vm_area *node)
+{
+    tree_update(node);
+    if (tree_height(node->left) > tree_height(node->right) + 1)
+    {
+        if (tree_height(node->left->right) > tree_height(node->left->left))
+        {
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(node);
+    }
+    if (tree_height(node->right) > tree_height(node->left) + 1)
+    {
+        if (tree_height(node->right->left) > tree_height(node->right->right))
+        {
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+// 插入区域，调用者已将区域链入链表
+static vm_area *tree_insert(vm_area *root, vm_area *vma)
+{
+    if (root == NULL)
+    {
+        vma->left = vma->right = NULL;
+        tree_update(vma);
+        return vma;
+    }
+    if (vma->start < root->start)
+    {
+        root->left = tree_insert(root->left, vma);
+    }
+    else
+    {
+        root->right = tree_insert(root->right, vma);
+    }
+    return tree_balance(root);
+}
+
+// 摘下子树中地址最低的区域，保存到 min
+static vm_area *tree_remove_min(vm_area *root, vm_area **min)
+{
+    if (root->left == NULL)
+    {
+        *min = root;
+        return root->right;
+    }
+    root->left = tree_remove_min(root->left, min);
+    return tree_balance(root);
+}
+
+static vm_area *tree_remove(vm_area *root, vm_area *vma)
+{
+    assert(root != NULL);
+    if (vma->start < root->start)
+    {
+        root->left = tree_remove(root->left, vma);
+        return tree_balance(root);
+    }
+    if (vma->start > root->start)
+    {
+        root->right = tree_remove(root->right, vma);
+        return tree_balance(root);
+    }
+
+    assert(root == vma);
+    if (vma->left == NULL || vma->right == NULL)
+    {
+        return vma->left != NULL ? vma->left : vma->right;
+    }
+    // 用右子树中地址最低的区域代替被删除的区域
+    vm_area *min = NULL;
+    vm_area *right = tree_remove_min(vma->right, &min);
+    min->left = vma->left;
+    min->right = right;
+    return tree_balance(min);
+}
+
+// 查找第一个结束地址大于 addr 的区域
+static vm_area *tree_lower_bound(const vm_map *map, uint32_t addr)
+{
+    vm_area *found = NULL;
+    for (vm_area *node = map->root; node != NULL;)
+    {
+        if (node->end > addr)
+        {
+            found = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+static vm_area *tree_last(const vm_map *map)
+{
+    vm_area *node = map->root;
+    while (node != NULL && node->right != NULL)
+    {
+        node = node->right;
+    }
+    return node;
+}
+
+// 将区域链入链表并插入树中，prev 为前一个区域
+static void vma_link(vm_map *map, vm_area *vma, vm_area *prev)
+{
+    vma->prev = prev;
+    vma->next = prev != NULL ? prev->next : map->head;
+    if (vma->next != NULL)
+    {
+        vma->next->prev = vma;
+    }
+    if (prev != NULL)
+    {
+        prev->next = vma;
+    }
+    else
+    {
+        map->head = vma;
+    }
+
+    map->root = tree_insert(map->root, vma);
+}
+
+static void vma_unlink(vm_map *map, vm_area *vma)
+{
+    map->root = tree_remove(map->root, vma);
+
+    if (vma->prev != NULL)
+    {
+        vma->prev->next = vma->next;
+    }
+    else
+    {
+        map->head = vma->next;
+    }
+    if (vma->next != NULL)
+    {
+        vma->next->prev = vma->prev;
+    }
+}
+
+/**
+ * 添加区域
+ *
+ * @param file 映射的文件，会增加引用计数，NULL 表示匿名区域
+ * @return 0 成功，-1 与已有区域重叠或内存不足
+ */
+int vma_add(vm_map *map, uint32_t start, uint32_t end, uint32_t flags,
+            open_file *file, off_t file_offset, uint32_t file_start, uint32_t file_end)
+{
+    assert(start % PAGE_SIZE == 0 && end % PAGE_SIZE == 0 && start < end);
+    assert(file == NULL || (start <= file_start && file_start <= file_end && file_end <= end));
+
+    // 找到后一个区域，并检查与前后区域是否重叠
+    vm_area *next = tree_lower_bound(map, start);
+    if (next != NULL && next->start < end)
+    {
+        DEBUGK("vma [%p, %p) overlaps [%p, %p)", start, end, next->start, next->end);
+        return -1;
+    }
+
+    vm_area *vma = kmem_cache_alloc(vma_cache);
+    if (vma == NULL)
+    {
+        return -1;
+    }
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags;
+    vma->file = file;
+    vma->file_offset = file_offset;
+    vma->file_start = file_start;
+    vma->file_end = file_end;
+    if (file != NULL)
+    {
+        open_file_get(file);
+    }
+
+    vma_link(map, vma, next != NULL ? next->prev : tree_last(map));
+    return 0;
+}
+
+/**
+ * 查找包含地址的区域
+ *
+ * @return 区域，NULL 表示地址不属于任何区域
+ */
+vm_area *vma_find(const vm_map *map, uint32_t addr)
+{
+    vm_area *vma = map->root;
+    while (vma != NULL)
+    {
+        if (addr < vma->start)
+        {
+            vma = vma->left;
+        }
+        else if (addr >= vma->end)
+        {
+            vma = vma->right;
+        }
+        else
+        {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 向下扩展栈区域，使其包含 addr
+ *
+ * addr 必须位于某个 VM_GROWSDOWN 区域下方，扩展后栈的大小不超过 limit
+ * 并且与下方的区域之间至少保留 STACK_GUARD_GAP 的空隙，空隙内的访问视为栈溢出
+ * 扩展时只修改区域范围，新的页在 vma_fault 中按需分配
+ *
+ * @param limit 栈大小上限
+ * @return 0 扩展成功，-1 addr 不属于栈的扩展范围
+ */
+int vma_grow_stack(vm_map *map, uint32_t addr, uint32_t limit)
+{
+    vm_area *vma = tree_lower_bound(map, addr);
+    if (vma == NULL || vma->start <= addr || !(vma->flags & VM_GROWSDOWN))
+    {
+        return -1;
+    }
+
+    uint32_t start = ALIGN_DOWN(addr, PAGE_SIZE);
+    vm_area *prev = vma->prev;
+    if (vma->end - start > limit || (prev != NULL && start - prev->end < STACK_GUARD_GAP))
+    {
+        DEBUGK("stack overflow at %p, stack [%p, %p)", addr, vma->start, vma->end);
+        return -1;
+    }
+    // 起始地址仍在前一个区域之后，在树中的位置不变
+    vma->start = start;
+    return 0;
+}
+
+/**
+ * 获取一页并填充区域在 page_addr 处的数据
+ *
+ * 只读区域中含有文件数据的页在运行同一程序的进程间共享，优先使用页缓存中已有的页
+ *
+ * @return 页的物理地址，0 表示内存不足
+ */
+static uint32_t vma_fill_page(const vm_area *vma, uint32_t page_addr)
+{
+    // 页内属于文件数据的范围
+    uint32_t start = page_addr;
+    uint32_t end = page_addr;
+    if (vma->file != NULL)
+    {
+        start = MAX(page_addr, vma->file_start);
+        end = MIN(page_addr + PAGE_SIZE, vma->file_end);
+    }
+    off_t offset = vma->file_offset + (start - vma->file_start);
+
+    int shared = !(vma->flags & VM_WRITE) && start < end;
+    if (shared)
+    {
+        uint32_t p_addr = page_cache_find(&vma->file->file, offset, start - page_addr, end - page_addr);
+        if (p_addr != 0)
+        {
+            return p_addr;
+        }
+    }
+
+    // 页内不属于文件的部分（包括 BSS）为 0，使用已清零的页就不需要再清零
+    uint32_t p_addr = pmu_alloc_user_zeroed();
+    if (p_addr == 0)
+    {
+        return 0;
+    }
+    if (start < end)
+    {
+        void *page = kmap(p_addr);
+        file_read(page + (start - page_addr), offset, end - start, &vma->file->file);
+        kunmap(page);
+    }
+    if (shared)
+    {
+        page_cache_add(&vma->file->file, offset, start - page_addr, end - page_addr, p_addr);
+    }
+    return p_addr;
+}
+
+/**
+ * 处理区域内未映射页的缺页异常，申请页并填充数据后映射到页目录
+ *
+ * @param addr 触发异常的线性地址
+ * @param write 是否为写访问
+ * @return 0 处理成功，-1 地址不属于任何区域、访问权限不符或者内存不足
+ */
+int vma_fault(page_dir_entry *page_dir, const vm_map *map, uint32_t addr, int write)
+{
+    vm_area *vma = vma_find(map, addr);
+    if (vma == NULL || (write && !(vma->flags & VM_WRITE)))
+    {
+        return -1;
+    }
+
+    uint32_t page_addr = ALIGN_DOWN(addr, PAGE_SIZE);
+    uint32_t p_addr = vma_fill_page(vma, page_addr);
+    if (p_addr == 0)
+    {
+        return -1;
+    }
+    if (map_physical_page_to_linear(page_dir, p_addr, page_addr, 1, (vma->flags & VM_WRITE) != 0) != 0)
+    {
+        release_user_page(p_addr);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 复制地址空间区域，用于 fork
+ *
+ * 已映射的页由页目录以写时复制方式共享，未映射的页在子进程中重新从文件读取
+ *
+ * @return 0 成功，-1 内存不足
+ */
+int vma_copy(vm_map *dst, const vm_map *src)
+{
+    assert(dst->head == NULL && dst->root == NULL);
+
+    vm_area *tail = NULL;
+    for (const vm_area *area = src->head; area != NULL; area = area->next)
+    {
+        vm_area *vma = kmem_cache_alloc(vma_cache);
+        if (vma == NULL)
+        {
+            vma_free(dst);
+            return -1;
+        }
+        *vma = *area;
+        if (vma->file != NULL)
+        {
+            open_file_get(vma->file);
+        }
+        vma_link(dst, vma, tail);
+        tail = vma;
+    }
+    return 0;
+}
+
+/**
+ * 释放所有区域，不处理页目录中已映射的页
+ */
+void vma_free(vm_map *map)
+{
+    vm_area *vma = map->head;
+    while (vma != NULL)
+    {
+        vm_area *next = vma->next;
+        if (vma->file != NULL)
+        {
+            open_file_put(vma->file);
+        }
+        kmem_cache_free(vma_cache, vma);
+        vma = next;
+    }
+    map->head = NULL;
+    map->root = NULL;
+}
+
+/**
+ * 调整堆区域的结束地址
+ *
+ * 堆是从 start 开始的匿名区域，大小为 0 时不存在对应的区域
+ * 扩大时只修改区域范围，新的页在首次访问时映射为全 0 的页
+ * 缩小时解除超出部分已映射的页，再次扩大后访问到的仍是全 0 的页
+ *
+ * @param start 堆起始地址，页对齐
+ * @param old_end 原结束地址，页对齐
+ * @param new_end 新结束地址，页对齐
+ * @return 0 成功，-1 与其他区域重叠或内存不足
+ */
+int vma_brk(page_dir_entry *page_dir, vm_map *map, uint32_t start, uint32_t old_end, uint32_t new_end)
+{
+    assert(start <= old_end && start <= new_end);
+
+    if (new_end == old_end)
+    {
+        return 0;
+    }
+    if (old_end == start)
+    {
+        return vma_add(map, start, new_end, VM_READ | VM_WRITE, NULL, 0, 0, 0);
+    }
+
+    vm_area *heap = vma_find(map, start);
+    assert(heap != NULL && heap->start == start && heap->end == old_end);
+
+    if (new_end > old_end)
+    {
+        // 不能进入栈区域下方的保护空隙
+        vm_area *next = heap->next;
+        // 从 new_end 一侧加上空隙，next->start 小于空隙时相减会下溢
+        if (next != NULL && new_end + ((next->flags & VM_GROWSDOWN) ? STACK_GUARD_GAP : 0) > next->start)
+        {
+            return -1;
+        }
+        heap->end = new_end;
+        return 0;
+    }
+
+    unmap_range(page_dir, new_end, old_end);
+    if (new_end == start)
+    {
+        vma_unlink(map, heap);
+        kmem_cache_free(vma_cache, heap);
+    }
+    else
+    {
+        heap->end = new_end;
+    }
+    return 0;
+}
+
+/**
+ * 执行用户内存访问模式建议
+ *
+ * 范围内的每一页都必须属于某个区域或者已经映射
+ * WILLNEED 提前映射区域内尚未访问的页，避免之后逐页触发缺页异常
+ * DONTNEED 解除区域内已映射页的映射，之后再访问时重新从文件读取或填充 0
+ * NORMAL/RANDOM/SEQUENTIAL 目前没有需要执行的操作
+ *
+ * @param addr 起始地址，必须页对齐
+ * @param len 范围长度
+ * @return 0 成功，-1 范围不合法
+ */
+int vma_advise(page_dir_entry *page_dir, const vm_map *map, uint32_t addr, size_t len, int advice)
+{
+    assert(page_dir != NULL);
+
+    if (addr % PAGE_SIZE != 0 || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    {
+        return -1;
+    }
+
+    uint32_t end = ALIGN_UP(addr + len, PAGE_SIZE);
+    if (end < addr || page_dir_index(addr) < kernel_area_page_dir_end_index)
+    {
+        return -1;
+    }
+
+    for (uint32_t page = addr; page < end; page += PAGE_SIZE)
+    {
+        if (vma_find(map, page) == NULL && !page_mapped(page_dir, page))
+        {
+            return -1;
+        }
+    }
+
+    tlb_batch batch;
+    tlb_batch_init(&batch, page_dir);
+    for (uint32_t page = addr; page < end; page += PAGE_SIZE)
+    {
+        vm_area *vma = vma_find(map, page);
+        if (vma == NULL)
+        {
+            continue;
+        }
+
+        if (advice == MADV_WILLNEED && !page_mapped(page_dir, page))
+        {
+            // WILLNEED 只是提示，内存不足时停止预先映射，剩余的页仍在访问时按需映射
+            uint32_t p_addr = vma_fill_page(vma, page);
+            if (p_addr == 0)
+            {
+                break;
+            }
+            if (map_physical_page_to_linear(page_dir, p_addr, page, 1, (vma->flags & VM_WRITE) != 0) != 0)
+            {
+                release_user_page(p_addr);
+                break;
+            }
+        }
+        else if (advice == MADV_DONTNEED)
+        {
+            unmap_page(page_dir, page, &batch);
+        }
+    }
+    tlb_batch_flush(&batch);
+    return 0;
+}
+
+void vma_init(void)
+{
+    vma_cache = kmem_cache_create("vm_area", sizeof(vm_area), 0, 0, NULL);
+    assert(vma_cache != NULL);
+}
@@ -0,0 +1,238 @@
+#include "kernel/vmalloc.h"
+#include "kernel/pmu.h"
+#include "kernel/slab.h"
+#include "kernel/page.h"
+#include "kernel/tlb.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * 内核虚拟内存分配（vmalloc）
+ *
+ * pmu_alloc_contiguous 需要物理上连续的页，内存碎片化后大块申请容易失败，且只能使用低端内存
+ * vmalloc 逐页申请物理页（优先高端内存），映射到 [VMALLOC_START, VMALLOC_END) 中一段连续的线性地址
+ * 适合只由内核通过线性地址访问、不需要物理连续的大缓冲区，如 romfs 镜像和交换区位图
+ *
+ * 区域按地址顺序串成链表，首次适应查找空闲的线性地址，每个区域之后留一页不映射的保护页，越界访问会触发缺页
+ *
+ * 映射只建立在内核页目录中，用户页目录在创建时复制内核区域的页目录项，之后新建的页表不会同步过去
+ * 用户页目录下访问 vmalloc 地址时缺页，由 vmalloc_fault 从内核页目录复制页目录项
+ * 页表在所有页目录间共享，建立后不再释放，所以复制过的页目录项始终有效，vfree 也只需要刷新当前页目录的 TLB
+ * 页表项不是全局页，切换页目录时会从 TLB 中清除
+ */
+
+// 已分配的区域
+typedef struct vmap_area
+{
+    uint32_t addr;          // 起始线性地址
+    uint32_t pages;         // 映射的页数，不包括保护页
+    struct vmap_area *next; // 地址更高的下一个区域
+} vmap_area;
+
+static kmem_cache *area_cache = NULL; // 区域描述符的对象缓存
+static vmap_area *areas = NULL;       // 已分配区域链表，按地址升序
+
+// 统计信息
+static struct
+{
+    uint32_t areas;       // 已分配的区域数量
+    uint32_t pages;       // 已映射的页数
+    uint32_t page_tables; // 已建立的页表数量
+    uint32_t syncs;       // 缺页时同步的页目录项数量
+    uint32_t fails;       // 申请失败次数
+} stats = {0};
+
+/**
+ * 在区域链表中查找能容纳 size 字节（包括保护页）的空闲线性地址
+ *
+ * @param prev 输出，新区域在链表中的前一个区域，NULL 表示插入到链表头
+ * @return 起始线性地址，0 表示线性地址空间不足
+ */
+static uint32_t find_free_range(uint32_t size, vmap_area **prev)
+{
+    uint32_t addr = VMALLOC_START;
+    *prev = NULL;
+    for (vmap_area *area = areas; area != NULL; area = area->next)
+    {
+        if (area->addr - addr >= size)
+        {
+            return addr;
+        }
+        addr = area->addr + (area->pages + 1) * PAGE_SIZE;
+        *prev = area;
+    }
+    return VMALLOC_END - addr >= size ? addr : 0;
+}
+
+/**
+ * 获取内核页目录中线性地址对应的页表项，页表不存在时创建
+ *
+ * @return 页表项，NULL 表示内存不足
+ */
+static page_tabel_entry *get_or_create_pte(uint32_t addr)
+{
+    page_dir_entry *pde = &get_kernel_page_dir()[page_dir_index(addr)];
+    if (!pde->present)
+    {
+        // 页表本身由内核通过恒等映射访问，必须位于低端内存
+        uint32_t page_table = pmu_alloc_zeroed();
+        if (page_table == 0)
+        {
+            return NULL;
+        }
+        pde->addr = page_table >> 12;
+        pde->present = 1;
+        pde->rw = 1;
+        pde->us = 0;
+        pde->ps = 0;
+        stats.page_tables++;
+    }
+    return &((page_tabel_entry *)(pde->addr << 12))[page_table_index(addr)];
+}
+
+/**
+ * 解除区域中前 count 页的映射并释放物理页
+ */
+static void unmap_area(uint32_t addr, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        page_tabel_entry *pte = get_page_table_entry(get_kernel_page_dir(), addr + i * PAGE_SIZE);
+        assert(pte != NULL && pte->present);
+        pmu_free(pte->addr << 12);
+        memset(pte, 0, sizeof(page_tabel_entry));
+    }
+    tlb_flush_range((const page_dir_entry *)get_cr3(), addr, addr + count * PAGE_SIZE);
+}
+
+/**
+ * 申请线性地址连续的内核内存，物理页不一定连续
+ *
+ * 返回的内存没有清零，以页为单位分配
+ *
+ * @param size 字节数
+ * @return 起始线性地址，NULL 表示线性地址空间或物理内存不足
+ */
+void *vmalloc(size_t size)
+{
+    uint32_t pages = CEIL_DIV(size, PAGE_SIZE);
+    if (pages == 0 || pages >= (VMALLOC_END - VMALLOC_START) / PAGE_SIZE)
+    {
+        return NULL;
+    }
+
+    vmap_area *prev = NULL;
+    uint32_t addr = find_free_range((pages + 1) * PAGE_SIZE, &prev);
+    vmap_area *area = addr != 0 ? kmem_cache_alloc(area_cache) : NULL;
+    if (area == NULL)
+    {
+        stats.fails++;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        page_tabel_entry *pte = get_or_create_pte(addr + i * PAGE_SIZE);
+        uint32_t page_addr = pte != NULL ? pmu_alloc_user() : 0;
+        if (page_addr == 0)
+        {
+            unmap_area(addr, i);
+            kmem_cache_free(area_cache, area);
+            stats.fails++;
+            return NULL;
+        }
+        // 线性地址原本没有映射，不需要刷新 TLB
+        pte->addr = page_addr >> 12;
+        pte->present = 1;
+        pte->rw = 1;
+        pte->us = 0;
+        pte->global = 0;
+    }
+
+    area->addr = addr;
+    area->pages = pages;
+    if (prev == NULL)
+    {
+        area->next = areas;
+        areas = area;
+    }
+    else
+    {
+        area->next = prev->next;
+        prev->next = area;
+    }
+
+    stats.areas++;
+    stats.pages += pages;
+    return (void *)addr;
+}
+
+/**
+ * 释放 vmalloc 申请的内存
+ *
+ * @param addr vmalloc 返回的地址，NULL 时不做任何处理
+ */
+void vfree(void *addr)
+{
+    if (addr == NULL)
+    {
+        return;
+    }
+
+    vmap_area **pos = &areas;
+    while (*pos != NULL && (*pos)->addr != (uint32_t)addr)
+    {
+        pos = &(*pos)->next;
+    }
+    assert(*pos != NULL);
+
+    vmap_area *area = *pos;
+    *pos = area->next;
+    unmap_area(area->addr, area->pages);
+
+    stats.areas--;
+    stats.pages -= area->pages;
+    kmem_cache_free(area_cache, area);
+}
+
+/**
+ * 处理 vmalloc 区域的缺页，从内核页目录复制当前页目录缺少的页目录项
+ *
+ * @param addr 触发缺页的线性地址
+ * @return 0 已同步，-1 不是 vmalloc 区域中已建立页表的地址
+ */
+int vmalloc_fault(uint32_t addr)
+{
+    if (addr < VMALLOC_START || addr >= VMALLOC_END)
+    {
+        return -1;
+    }
+
+    uint32_t index = page_dir_index(addr);
+    const page_dir_entry *kernel_pde = &get_kernel_page_dir()[index];
+    page_dir_entry *pde = &((page_dir_entry *)get_cr3())[index];
+    if (!kernel_pde->present || pde->present)
+    {
+        return -1;
+    }
+    *pde = *kernel_pde;
+    stats.syncs++;
+    return 0;
+}
+
+/**
+ * 输出 vmalloc 的统计信息
+ */
+void vmalloc_info(void)
+{
+    printk("vmalloc: %u areas, %u pages, %u page tables, %u pde syncs, %u failures\n",
+           stats.areas, stats.pages, stats.page_tables, stats.syncs, stats.fails);
+}
+
+void vmalloc_init(void)
+{
+    area_cache = kmem_cache_create("vmap_area", sizeof(vmap_area), 0, 0, NULL);
+    assert(area_cache != NULL);
+}
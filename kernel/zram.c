@@ -0,0 +1,258 @@
+#include "kernel/zram.h"
+#include "kernel/pmu.h"
+#include "kernel/page.h"
+#include "kernel/lz4.h"
+#include "kernel/cpu.h"
+#include "kernel/x86.h"
+#include "kernel/kernel.h"
+#include "algobase.h"
+#include "string.h"
+
+/**
+ * 内存压缩交换区（zram）
+ *
+ * 回收的页用 LZ4 压缩后保存在内存池中，再次访问时解压读回，比通过 PIO 读写磁盘快得多
+ * 换出页的页表项保存槽位号，槽位表记录压缩数据的位置、大小和引用计数
+ *
+ * 内存池由 pmu 的物理页组成，每页按大小类别切分为相同大小的块，类别粒度为 ZRAM_CLASS_SIZE
+ * 与 slab 类似，页的空闲块链表和已用块数保存在 page_frame 中，有空闲块的页串在所属类别的链表里
+ * 一页中的块全部释放后归还 pmu
+ *
+ * 回收发生在物理内存耗尽时，内存池此时可能无法申请新页
+ * 这种情况下直接使用被回收的页作为内存池的新页（页的内容已经压缩到缓冲区中）
+ * 内存池的页由内核直接访问，必须位于低端内存，被回收的页位于高端内存时不能这样使用
+ */
+
+// 槽位，空闲时 addr 为下一个空闲槽位号
+typedef struct zram_slot
+{
+    uint32_t addr; // 压缩数据地址
+    uint16_t size; // 压缩数据大小，0 表示空闲
+    uint8_t refs;  // 引用计数，fork 后父子进程的换出页共享同一个槽位
+} zram_slot;
+
+static zram_slot slots[ZRAM_SLOTS];                   // 槽位表，槽位 0 保留
+static uint32_t free_slot = 0;                        // 空闲槽位链表头，0 表示没有空闲槽位
+static page_frame *classes[ZRAM_CLASSES];             // 各大小类别中有空闲块的页
+static uint8_t buffer[LZ4_COMPRESS_BOUND(PAGE_SIZE)]; // 压缩缓冲区
+
+// 统计信息
+static struct
+{
+    uint32_t stored;      // 保存的页数
+    uint32_t compressed;  // 压缩数据总字节数
+    uint32_t pool_pages;  // 内存池页数
+    uint32_t rejects;     // 不可压缩而未保存的页数
+    uint32_t loads;       // 解压读回的页数
+    uint32_t load_cycles; // 解压读回耗费的 TSC 周期数
+} stats = {0};
+
+static inline uint32_t class_size(uint32_t cls)
+{
+    return (cls + 1) * ZRAM_CLASS_SIZE;
+}
+
+// 将内存池页加入类别链表头部
+static void class_list_add(uint32_t cls, page_frame *frame)
+{
+    frame->prev = NULL;
+    frame->next = classes[cls];
+    if (classes[cls] != NULL)
+    {
+        classes[cls]->prev = frame;
+    }
+    classes[cls] = frame;
+}
+
+static void class_list_del(uint32_t cls, page_frame *frame)
+{
+    if (frame->prev != NULL)
+    {
+        frame->prev->next = frame->next;
+    }
+    else
+    {
+        classes[cls] = frame->next;
+    }
+    if (frame->next != NULL)
+    {
+        frame->next->prev = frame->prev;
+    }
+    frame->prev = frame->next = NULL;
+}
+
+/**
+ * 将页切分为类别 cls 的块，加入类别链表
+ */
+static page_frame *pool_page_init(uint32_t cls, uint32_t addr)
+{
+    page_frame *frame = pmu_frame(addr);
+    uint32_t size = class_size(cls);
+
+    frame->freelist = NULL;
+    for (uint32_t i = PAGE_SIZE / size; i-- > 0;)
+    {
+        void *chunk = (void *)addr + i * size;
+        *(void **)chunk = frame->freelist;
+        frame->freelist = chunk;
+    }
+    frame->inuse = 0;
+    class_list_add(cls, frame);
+
+    stats.pool_pages++;
+    return frame;
+}
+
+/**
+ * 压缩页并保存到内存池
+ *
+ * @param page_addr 被回收页的物理地址，调用者保证没有其他映射
+ * @param adopted 输出，为 1 时页已成为内存池的一部分，调用者不能再释放该页
+ * @return 槽位号，0 表示页不可压缩或者没有空闲槽位
+ */
+uint32_t zram_store(uint32_t page_addr, int *adopted)
+{
+    *adopted = 0;
+    if (free_slot == 0)
+    {
+        return 0;
+    }
+
+    void *page = kmap(page_addr);
+    size_t size = lz4_compress(page, PAGE_SIZE, buffer);
+    kunmap(page);
+    if (size > ZRAM_MAX_OBJ)
+    {
+        stats.rejects++;
+        return 0;
+    }
+
+    uint32_t cls = (size - 1) / ZRAM_CLASS_SIZE;
+    page_frame *frame = classes[cls];
+    if (frame == NULL)
+    {
+        // 不能调用 pmu_alloc，否则内存耗尽时会再次进入回收
+        uint32_t addr = pmu_alloc_pages(0);
+        if (addr == 0 && page_addr >= LOWMEM_END)
+        {
+            return 0;
+        }
+        if (addr == 0)
+        {
+            addr = page_addr;
+            *adopted = 1;
+        }
+        frame = pool_page_init(cls, addr);
+    }
+
+    void *chunk = frame->freelist;
+    frame->freelist = *(void **)chunk;
+    frame->inuse++;
+    if (frame->freelist == NULL)
+    {
+        class_list_del(cls, frame);
+    }
+    memcpy(chunk, buffer, size);
+
+    uint32_t id = free_slot;
+    free_slot = slots[id].addr;
+    slots[id].addr = (uint32_t)chunk;
+    slots[id].size = size;
+    slots[id].refs = 1;
+
+    stats.stored++;
+    stats.compressed += size;
+    return id;
+}
+
+/**
+ * 解压槽位中的页
+ *
+ * @return 0 成功，-1 数据损坏
+ */
+int zram_load(uint32_t id, uint32_t page_addr)
+{
+    assert(id > 0 && id < ZRAM_SLOTS && slots[id].refs > 0);
+
+    uint32_t start = cpu_has_feature(CPU_FEATURE_TSC) ? rdtsc() : 0;
+    void *page = kmap(page_addr);
+    int size = lz4_decompress((void *)slots[id].addr, slots[id].size, page, PAGE_SIZE);
+    kunmap(page);
+    if (cpu_has_feature(CPU_FEATURE_TSC))
+    {
+        stats.load_cycles += rdtsc() - start;
+    }
+    stats.loads++;
+    return size == PAGE_SIZE ? 0 : -1;
+}
+
+/**
+ * 增加槽位的引用，fork 复制换出页的页表项时调用
+ */
+void zram_dup(uint32_t id)
+{
+    assert(id > 0 && id < ZRAM_SLOTS && slots[id].refs > 0);
+    slots[id].refs++;
+}
+
+/**
+ * 减少槽位的引用，没有引用时释放压缩数据和槽位
+ */
+void zram_free(uint32_t id)
+{
+    assert(id > 0 && id < ZRAM_SLOTS && slots[id].refs > 0);
+    if (--slots[id].refs > 0)
+    {
+        return;
+    }
+
+    void *chunk = (void *)slots[id].addr;
+    uint32_t cls = (slots[id].size - 1) / ZRAM_CLASS_SIZE;
+    page_frame *frame = pmu_frame(ALIGN_DOWN((uint32_t)chunk, PAGE_SIZE));
+
+    // 已满的页重新有了空闲块
+    if (frame->freelist == NULL)
+    {
+        class_list_add(cls, frame);
+    }
+    *(void **)chunk = frame->freelist;
+    frame->freelist = chunk;
+    frame->inuse--;
+
+    if (frame->inuse == 0)
+    {
+        class_list_del(cls, frame);
+        frame->freelist = NULL;
+        pmu_free(pmu_frame_addr(frame));
+        stats.pool_pages--;
+    }
+
+    stats.stored--;
+    stats.compressed -= slots[id].size;
+    slots[id].size = 0;
+    slots[id].addr = free_slot;
+    free_slot = id;
+}
+
+/**
+ * 输出压缩交换区的统计信息
+ */
+void zram_info(void)
+{
+    // 压缩率按内存池实际占用的页计算，包括块内和页内的浪费
+    uint32_t ratio = stats.pool_pages > 0 ? stats.stored * 100 / stats.pool_pages : 0;
+    printk("zram: %u pages in %u pool pages (%u%%), %u bytes compressed, %u rejected\n",
+           stats.stored, stats.pool_pages, ratio, stats.compressed, stats.rejects);
+    printk("zram: %u loads, %u cycles per load\n",
+           stats.loads, stats.loads > 0 ? stats.load_cycles / stats.loads : 0);
+}
+
+void zram_init(void)
+{
+    // 串联空闲槽位，槽位 0 保留表示失败
+    for (uint32_t id = ZRAM_SLOTS - 1; id > 0; id--)
+    {
+        slots[id].addr = free_slot;
+        free_slot = id;
+    }
+}
@@ -0,0 +1,340 @@
+#include "stdlib.h"
+#include "unistd.h"
+#include "string.h"
+#include "algobase.h"
+
+/**
+ * 用户程序的内存分配器，堆内存通过 sbrk 从内核申请
+ *
+ * 小对象（不超过 SMALL_MAX 字节）按 8 字节划分大小类别，每个类别一个空闲链表
+ * 链表为空时从当前的小对象区块中顺序切分（bump 分配），区块用完后再申请一个新的区块
+ * 小对象释放后放回所属类别的链表头部，不与相邻的块合并，所以申请和释放都是 O(1)
+ *
+ * 大对象使用边界标记管理，每个块的头部记录物理上前一个块的大小
+ * 空闲块组成双向链表，按首次适配查找，分配时切分多余部分
+ * 释放时与前后相邻的空闲块合并，避免长时间运行后产生大量碎片
+ * 小对象区块本身是一个不会释放的大块，所以两种块不会互相合并
+ */
+
+#define ALIGNMENT 8                                // 返回地址的对齐
+#define HEADER_SIZE 8                              // 块头部大小（prev_size 与 size）
+#define MIN_BLOCK (HEADER_SIZE + 2 * sizeof(void *)) // 大块的最小大小，空闲时要容纳链表指针
+#define SMALL_MAX 256                              // 小对象的最大大小
+#define SMALL_CLASSES (SMALL_MAX / ALIGNMENT)      // 小对象的大小类别数量
+#define CHUNK_SIZE 4096                            // 小对象区块大小
+#define HEAP_GROW (16 * 1024)                      // 每次扩大堆的最小字节数
+
+// 块大小中的标志位，块大小总是 8 的倍数，所以低 3 位可以用于标志
+#define B_INUSE 0x1 // 块已分配
+#define B_SMALL 0x2 // 小对象块
+#define B_FLAGS 0x7
+
+typedef struct block
+{
+    size_t prev_size; // 物理上前一个大块的大小，0 表示没有前一个块
+    size_t size;      // 块大小（包括头部）和标志位
+    // 以下字段位于数据区，只在空闲的大块中有效
+    struct block *next;
+    struct block *prev;
+} block;
+
+static void *small_free[SMALL_CLASSES]; // 各类别小对象的空闲链表
+static char *bump_ptr = NULL;           // 当前小对象区块中下一个可用的位置
+static char *bump_end = NULL;           // 当前小对象区块的结束地址
+
+static block *free_list = NULL; // 空闲大块链表
+static block *epilogue = NULL;  // 堆末尾的结束标记，大小为 0 的已分配块
+
+static inline size_t block_size(const block *b)
+{
+    return b->size & ~B_FLAGS;
+}
+
+static inline block *next_block(const block *b)
+{
+    return (block *)((char *)b + block_size(b));
+}
+
+static inline void *block_data(block *b)
+{
+    return (char *)b + HEADER_SIZE;
+}
+
+static inline block *data_block(void *ptr)
+{
+    return (block *)((char *)ptr - HEADER_SIZE);
+}
+
+// 设置大块的大小和标志，同时更新后一个块记录的 prev_size
+static void set_block(block *b, size_t size, size_t flags)
+{
+    b->size = size | flags;
+    next_block(b)->prev_size = size;
+}
+
+static void free_list_add(block *b)
+{
+    b->prev = NULL;
+    b->next = free_list;
+    if (free_list != NULL)
+    {
+        free_list->prev = b;
+    }
+    free_list = b;
+}
+
+static void free_list_del(block *b)
+{
+    if (b->prev != NULL)
+    {
+        b->prev->next = b->next;
+    }
+    else
+    {
+        free_list = b->next;
+    }
+    if (b->next != NULL)
+    {
+        b->next->prev = b->prev;
+    }
+}
+
+/**
+ * 释放大块，与前后相邻的空闲块合并后放入空闲链表
+ */
+static void large_free(block *b)
+{
+    size_t size = block_size(b);
+
+    block *next = next_block(b);
+    if (!(next->size & B_INUSE))
+    {
+        free_list_del(next);
+        size += block_size(next);
+    }
+
+    if (b->prev_size != 0)
+    {
+        block *prev = (block *)((char *)b - b->prev_size);
+        if (!(prev->size & B_INUSE))
+        {
+            free_list_del(prev);
+            size += block_size(prev);
+            b = prev;
+        }
+    }
+
+    set_block(b, size, 0);
+    free_list_add(b);
+}
+
+/**
+ * 扩大堆，新的空间作为空闲块加入链表，并与原来末尾的空闲块合并
+ *
+ * @param need 至少需要的字节数
+ * @return 0 成功，-1 内核拒绝扩大堆
+ */
+static int heap_grow(size_t need)
+{
+    // 其他代码以非对齐的增量调用过 sbrk 时，新空间首尾对齐会损失共 ALIGNMENT 字节，预留出来保证新块不小于 need
+    size_t incr = ALIGN_UP(need + HEADER_SIZE + ALIGNMENT, HEAP_GROW);
+    char *p = sbrk(incr);
+    if (p == (void *)-1)
+    {
+        return -1;
+    }
+    // 结束标记的位置，向下对齐使块大小是 ALIGNMENT 的倍数，不会覆盖标志位
+    char *end = (char *)ALIGN_DOWN((uint32_t)(p + incr), ALIGNMENT) - HEADER_SIZE;
+
+    block *b;
+    size_t size;
+    if (epilogue == NULL)
+    {
+        // 首次扩大，末尾保留结束标记的空间
+        b = (block *)ALIGN_UP((uint32_t)p, ALIGNMENT);
+        b->prev_size = 0;
+        size = end - (char *)b;
+    }
+    else if (p == (char *)epilogue + HEADER_SIZE)
+    {
+        // 新空间与堆末尾相邻，原来的结束标记成为新块的头部
+        b = epilogue;
+        size = end - (char *)b;
+    }
+    else
+    {
+        // 其他代码也调用了 sbrk，把中间的空隙变成一个不会释放的已分配块
+        b = (block *)ALIGN_UP((uint32_t)p, ALIGNMENT);
+        set_block(epilogue, (char *)b - (char *)epilogue, B_INUSE);
+        size = end - (char *)b;
+    }
+
+    epilogue = (block *)((char *)b + size);
+    epilogue->size = B_INUSE;
+    set_block(b, size, B_INUSE);
+    large_free(b);
+    return 0;
+}
+
+/**
+ * 按首次适配申请大块，多余部分足够大时切分出来
+ *
+ * @param size 数据区大小
+ */
+static void *large_alloc(size_t size)
+{
+    size_t need = MAX(ALIGN_UP(size, ALIGNMENT) + HEADER_SIZE, MIN_BLOCK);
+
+    block *b = free_list;
+    while (b != NULL && block_size(b) < need)
+    {
+        b = b->next;
+    }
+    if (b == NULL)
+    {
+        if (heap_grow(need) != 0)
+        {
+            return NULL;
+        }
+        // 新空间已与末尾的空闲块合并，并位于链表头部
+        b = free_list;
+    }
+
+    free_list_del(b);
+    size_t rest = block_size(b) - need;
+    if (rest >= MIN_BLOCK)
+    {
+        set_block(b, need, B_INUSE);
+        block *tail = next_block(b);
+        set_block(tail, rest, 0);
+        free_list_add(tail);
+    }
+    else
+    {
+        b->size |= B_INUSE;
+    }
+    return block_data(b);
+}
+
+/**
+ * 申请小对象，优先复用同类别释放的对象，否则从区块中顺序切分
+ */
+static void *small_alloc(size_t size)
+{
+    size_t cls = (size + ALIGNMENT - 1) / ALIGNMENT - 1;
+    void *ptr = small_free[cls];
+    if (ptr != NULL)
+    {
+        small_free[cls] = *(void **)ptr;
+        return ptr;
+    }
+
+    size_t need = (cls + 1) * ALIGNMENT + HEADER_SIZE;
+    if (bump_ptr == NULL || bump_ptr + need > bump_end)
+    {
+        // 当前区块剩余空间不足，剩余部分不再使用
+        bump_ptr = large_alloc(CHUNK_SIZE - HEADER_SIZE);
+        if (bump_ptr == NULL)
+        {
+            return NULL;
+        }
+        bump_end = bump_ptr + block_size(data_block(bump_ptr)) - HEADER_SIZE;
+    }
+
+    block *b = (block *)bump_ptr;
+    b->prev_size = 0;
+    b->size = need | B_SMALL | B_INUSE;
+    bump_ptr += need;
+    return block_data(b);
+}
+
+void *malloc(size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+    if (size <= SMALL_MAX)
+    {
+        return small_alloc(size);
+    }
+    return large_alloc(size);
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    block *b = data_block(ptr);
+    if (b->size & B_SMALL)
+    {
+        size_t cls = (block_size(b) - HEADER_SIZE) / ALIGNMENT - 1;
+        *(void **)ptr = small_free[cls];
+        small_free[cls] = ptr;
+        return;
+    }
+    large_free(b);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > (size_t)-1 / size)
+    {
+        return NULL;
+    }
+    void *ptr = malloc(count * size);
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/**
+ * 调整已申请内存的大小
+ *
+ * 原来的块足够大时直接返回，大块的后一个块空闲且合并后足够大时原地扩大
+ * 否则申请新的内存并复制数据
+ */
+void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return malloc(size);
+    }
+    if (size == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    block *b = data_block(ptr);
+    size_t old_size = block_size(b) - HEADER_SIZE;
+    if (size <= old_size)
+    {
+        return ptr;
+    }
+
+    if (!(b->size & B_SMALL))
+    {
+        size_t need = ALIGN_UP(size, ALIGNMENT) + HEADER_SIZE;
+        block *next = next_block(b);
+        if (!(next->size & B_INUSE) && block_size(b) + block_size(next) >= need)
+        {
+            free_list_del(next);
+            set_block(b, block_size(b) + block_size(next), B_INUSE);
+            return ptr;
+        }
+    }
+
+    void *new_ptr = malloc(size);
+    if (new_ptr != NULL)
+    {
+        memcpy(new_ptr, ptr, old_size);
+        free(ptr);
+    }
+    return new_ptr;
+}
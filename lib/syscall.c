@@ -10,6 +10,7 @@ int syscall(int syscall_no, ...)
     int32_t arg1 = va_arg(args, int32_t);
     int32_t arg2 = va_arg(args, int32_t);
     int32_t arg3 = va_arg(args, int32_t);
+    int32_t arg4 = va_arg(args, int32_t);
     
     va_end(args);
     
@@ -18,7 +19,7 @@ int syscall(int syscall_no, ...)
     asm volatile (
         "int $0x80"
         : "=a" (ret)
-        : "a" (syscall_no), "b" (arg1), "c" (arg2), "d" (arg3)
+        : "a" (syscall_no), "b" (arg1), "c" (arg2), "d" (arg3), "S" (arg4)
         : "memory"
     );
     return ret;
@@ -66,4 +67,97 @@ int execl(const char *path, const char *arg0, ...)
     va_end(args);
     
     return ret;
-}
\ No newline at end of file
+}
+
+/**
+ * 从可执行文件创建子进程，相当于 fork() 后在子进程中 execl()，但不复制当前进程的地址空间
+ *
+ * @param path 可执行文件绝对路径
+ * @param arg0 与 execl 相同，最后一个参数必须是 NULL
+ * @return 子进程 pid，-1 表示失败
+ */
+pid_t spawnl(const char *path, const char *arg0, ...)
+{
+    va_list args;
+    va_start(args, path);
+
+    pid_t ret = syscall(SYS_NR_SPAWN, path, args);
+
+    va_end(args);
+
+    return ret;
+}
+
+int open(const char *path)
+{
+    return syscall(SYS_NR_OPEN, path);
+}
+int read(int fd, void *buf, int count)
+{
+    return syscall(SYS_NR_READ, fd, buf, count);
+}
+int close(int fd)
+{
+    return syscall(SYS_NR_CLOSE, fd);
+}
+
+/**
+ * @param len 范围长度，0 表示到文件末尾
+ * @param advice 访问模式建议，POSIX_FADV_*
+ */
+int posix_fadvise(int fd, off_t offset, off_t len, int advice)
+{
+    return syscall(SYS_NR_FADVISE, fd, offset, len, advice);
+}
+
+/**
+ * @param addr 起始地址，必须页对齐
+ * @param advice 访问模式建议，MADV_*
+ */
+int madvise(void *addr, size_t len, int advice)
+{
+    return syscall(SYS_NR_MADVISE, addr, len, advice);
+}
+
+// 输出内核内存使用情况
+int meminfo(void)
+{
+    return syscall(SYS_NR_MEMINFO);
+}
+
+// 让出 CPU，调度其他就绪任务
+int yield(void)
+{
+    return syscall(SYS_NR_YIELD);
+}
+
+/**
+ * 设置堆的结束地址
+ *
+ * @return 0 成功，-1 失败
+ */
+int brk(void *addr)
+{
+    return (void *)syscall(SYS_NR_BRK, addr) == addr ? 0 : -1;
+}
+
+/**
+ * 调整堆的大小
+ *
+ * @param increment 增加的字节数，可以为负数
+ * @return 调整前的堆结束地址，(void *)-1 表示失败
+ */
+void *sbrk(int increment)
+{
+    uint32_t old_brk = syscall(SYS_NR_BRK, 0);
+    if (increment == 0)
+    {
+        return (void *)old_brk;
+    }
+    uint32_t new_brk = syscall(SYS_NR_BRK, old_brk + increment);
+    if (new_brk != old_brk + increment)
+    {
+        return (void *)-1;
+    }
+    return (void *)old_brk;
+}
@@ -0,0 +1,816 @@
+/**
+ * FAT16 磁盘镜像生成工具（宿主机程序）
+ *
+ * 根据清单文件直接生成带 MBR 分区表的 FAT16 磁盘镜像，不需要 loop 挂载和 sudo
+ * 清单中的文件按出现顺序（即访问顺序）依次分配连续的簇，保证每个文件只占一段连续簇
+ * 目录在其首个文件之前分配，目录条目也按首次出现的顺序排列，常用文件位于目录开头
+ *
+ * 生成的镜像不包含引导程序，需要再由 boot/ 下的脚本写入 MBR 与 MBR gap
+ *
+ * Usage:
+ *   mkimage [-s size_mib] [-w swap_mib] -o <image> <manifest>  根据清单生成镜像，-w 在镜像末尾划分交换分区
+ *   mkimage -f <image>                           统计已有镜像的文件碎片情况
+ *
+ * 清单文件每行格式为 “<宿主机文件路径> <镜像内绝对路径>”，# 开头的行为注释
+ * 镜像内路径的每一级都必须是合法的 8.3 短文件名
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#define SECT_SIZE 512
+#define PART_START_LBA 2048      // 分区起始扇区（1 MiB 对齐）
+#define PART_TYPE_FAT16_LBA 0x0E // 分区类型 W95 FAT16 (LBA)
+#define PART_TYPE_LINUX_SWAP 0x82 // 分区类型 Linux swap，内核用作交换区
+#define MBR_BOOTABLE_FLAG 0x80
+#define ROOT_ENT_CNT 512
+#define NUM_FATS 2
+#define RSVD_SEC_CNT 1
+#define FAT16_MIN_CLUSTERS 4085
+#define FAT16_MAX_CLUSTERS 65524
+#define FAT16_EOC 0xFFFF
+
+#define FAT_ATTR_VOLUME_ID 0x08
+#define FAT_ATTR_DIRECTORY 0x10
+#define FAT_ATTR_ARCHIVE 0x20
+#define FAT_ATTR_LFN 0x0F
+#define FAT_ENTRY_DELETED 0xE5
+
+#define CEIL_DIV(a, b) (((a) + (b) - 1) / (b))
+
+// 以下结构与 inc/kernel/mbr.h, inc/kernel/fat16.h 保持一致
+typedef struct partition_entry
+{
+    uint8_t boot_indicator;
+    uint8_t start_chs[3];
+    uint8_t partition_type;
+    uint8_t end_chs[3];
+    uint32_t start_lba;
+    uint32_t num_sectors;
+} __attribute__((packed)) partition_entry;
+
+typedef struct mbr_struct
+{
+    uint8_t boot_code[446];
+    partition_entry partitions[4];
+    uint16_t signature;
+} __attribute__((packed)) mbr_struct;
+
+typedef struct bpb_struct
+{
+    uint16_t byte_per_sec;
+    uint8_t sec_per_clus;
+    uint16_t rsvd_sec_cnt;
+    uint8_t num_fats;
+    uint16_t root_ent_cnt;
+    uint16_t tot_sec_16;
+    uint8_t media;
+    uint16_t sec_per_fat_16;
+    uint16_t sec_per_track;
+    uint16_t num_heads;
+    uint32_t hidd_sec;
+    uint32_t tot_sec_32;
+} __attribute__((packed)) bpb_struct;
+
+typedef struct ebpb_struct
+{
+    uint8_t drv_num;
+    uint8_t reserved_1;
+    uint8_t boot_sig;
+    uint32_t vol_id;
+    uint8_t vol_lab[11];
+    uint8_t fs_type[8];
+} __attribute__((packed)) ebpb_struct;
+
+typedef struct fat_boot_sector
+{
+    uint8_t jump_ins[3];
+    uint8_t OEM[8];
+    bpb_struct bpb;
+    ebpb_struct ebpb;
+} __attribute__((packed)) fat_boot_sector;
+
+typedef struct fat_dir_entry
+{
+    uint8_t name[8];
+    uint8_t ext[3];
+    uint8_t attr;
+    uint8_t NT_res;
+    uint8_t crt_time_tenth;
+    uint16_t crt_time;
+    uint16_t crt_date;
+    uint16_t lst_acc_date;
+    uint16_t ea_index;
+    uint16_t wrt_time;
+    uint16_t wrt_date;
+    uint16_t fst_clus;
+    uint32_t file_size;
+} __attribute__((packed)) fat_dir_entry;
+
+// FAT16 卷参数
+typedef struct volume
+{
+    uint8_t *base;          // 分区在内存中的起始位置
+    bpb_struct bpb;
+    uint32_t fat_start;     // FAT 表起始扇区（相对分区）
+    uint32_t root_start;    // 根目录起始扇区（相对分区）
+    uint32_t root_sectors;  // 根目录扇区数量
+    uint32_t data_start;    // 数据区起始扇区（相对分区）
+    uint32_t cluster_count; // 数据区簇数量
+    uint32_t clus_size;     // 簇字节数
+} volume;
+
+// 镜像内的文件或目录
+typedef struct node
+{
+    char short_name[11]; // 8.3 短文件名，空格填充
+    const char *name;    // 原始名称
+    int is_dir;
+    const char *src; // 宿主机文件路径（仅文件）
+    uint32_t size;   // 文件大小（仅文件）
+    uint32_t entry_count; // 目录条目数量（仅目录，含 . 和 ..）
+    uint16_t fst_clus;
+    uint32_t clus_count;
+    struct node *parent;
+    struct node *child;      // 首个子节点
+    struct node *last_child; // 最后一个子节点，用于按插入顺序追加
+    struct node *sibling;
+} node;
+
+/* ======================================== */
+
+static void die(const char *msg, const char *arg)
+{
+    fprintf(stderr, "mkimage: %s%s%s\n", msg, arg ? ": " : "", arg ? arg : "");
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: mkimage [-s size_mib] [-w swap_mib] -o <image> <manifest>\n"
+            "       mkimage -f <image>\n");
+    exit(1);
+}
+
+/**
+ * 将文件名转换为 8.3 短文件名
+ *
+ * @return 0 成功，-1 不是合法的短文件名
+ */
+static int to_short_name(const char *name, char out[11])
+{
+    static const char *invalid = "\"*+,/:;<=>?[\\]|. ";
+
+    memset(out, ' ', 11);
+    const char *dot = strrchr(name, '.');
+    size_t base_len = dot ? (size_t)(dot - name) : strlen(name);
+    size_t ext_len = dot ? strlen(dot + 1) : 0;
+
+    if (base_len == 0 || base_len > 8 || ext_len > 3 || (dot && ext_len == 0))
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < base_len + (dot ? ext_len + 1 : 0); i++)
+    {
+        if (name + i == dot)
+        {
+            continue;
+        }
+        unsigned char c = name[i];
+        if (c < 0x20 || c >= 0x7F || strchr(invalid, c))
+        {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < base_len; i++)
+    {
+        out[i] = toupper((unsigned char)name[i]);
+    }
+    for (size_t i = 0; i < ext_len; i++)
+    {
+        out[8 + i] = toupper((unsigned char)dot[1 + i]);
+    }
+    return 0;
+}
+
+static node *new_node(const char *name, int is_dir, node *parent)
+{
+    node *n = calloc(1, sizeof(node));
+    if (n == NULL)
+    {
+        die("out of memory", NULL);
+    }
+    n->name = name;
+    n->is_dir = is_dir;
+    n->parent = parent;
+    if (parent == NULL)
+    {
+        return n;
+    }
+    if (to_short_name(name, n->short_name) != 0)
+    {
+        die("not a valid 8.3 file name", name);
+    }
+    for (node *c = parent->child; c != NULL; c = c->sibling)
+    {
+        if (memcmp(c->short_name, n->short_name, 11) == 0)
+        {
+            die("duplicate path component", name);
+        }
+    }
+    // 追加到末尾，保持首次出现的顺序
+    if (parent->last_child == NULL)
+    {
+        parent->child = n;
+    }
+    else
+    {
+        parent->last_child->sibling = n;
+    }
+    parent->last_child = n;
+    parent->entry_count++;
+    return n;
+}
+
+static node *find_child(node *dir, const char *name)
+{
+    char short_name[11];
+    if (to_short_name(name, short_name) != 0)
+    {
+        die("not a valid 8.3 file name", name);
+    }
+    for (node *c = dir->child; c != NULL; c = c->sibling)
+    {
+        if (memcmp(c->short_name, short_name, 11) == 0)
+        {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 将镜像内路径加入目录树，返回文件节点
+ */
+static node *add_path(node *root, char *path)
+{
+    if (path[0] != '/')
+    {
+        die("image path must be absolute", path);
+    }
+
+    node *dir = root;
+    char *save = NULL;
+    char *name = strtok_r(path, "/", &save);
+    while (name != NULL)
+    {
+        char *next = strtok_r(NULL, "/", &save);
+        node *n = find_child(dir, name);
+        if (next == NULL)
+        {
+            if (n != NULL)
+            {
+                die("duplicate path", name);
+            }
+            return new_node(name, 0, dir);
+        }
+        if (n == NULL)
+        {
+            n = new_node(name, 1, dir);
+            n->entry_count = 2; // . 和 ..
+        }
+        else if (!n->is_dir)
+        {
+            die("path component is a file", name);
+        }
+        dir = n;
+        name = next;
+    }
+    die("empty image path", NULL);
+    return NULL;
+}
+
+/* ======================================== */
+
+static inline uint16_t *fat_table(const volume *vol, int index)
+{
+    return (uint16_t *)(vol->base + (vol->fat_start + index * vol->bpb.sec_per_fat_16) * SECT_SIZE);
+}
+
+static inline uint8_t *clus_data(const volume *vol, uint16_t clus)
+{
+    return vol->base + (vol->data_start + (clus - 2) * vol->bpb.sec_per_clus) * SECT_SIZE;
+}
+
+/**
+ * 根据分区大小计算 FAT16 参数
+ */
+static void format_volume(volume *vol, uint8_t *base, uint32_t total_sectors)
+{
+    memset(vol, 0, sizeof(*vol));
+    vol->base = base;
+    vol->root_sectors = CEIL_DIV(ROOT_ENT_CNT * sizeof(fat_dir_entry), SECT_SIZE);
+
+    // 选取使簇数量不超过 FAT16 上限的最小簇大小
+    uint32_t spc, sec_per_fat, clusters;
+    for (spc = 1; spc <= 128; spc <<= 1)
+    {
+        // FAT 表大小与簇数量互相依赖，迭代到稳定
+        sec_per_fat = 1;
+        for (int i = 0; i < 8; i++)
+        {
+            uint32_t data_sectors = total_sectors - RSVD_SEC_CNT - NUM_FATS * sec_per_fat - vol->root_sectors;
+            clusters = data_sectors / spc;
+            sec_per_fat = CEIL_DIV((clusters + 2) * 2, SECT_SIZE);
+        }
+        if (clusters <= FAT16_MAX_CLUSTERS)
+        {
+            break;
+        }
+    }
+    if (spc > 128 || clusters < FAT16_MIN_CLUSTERS)
+    {
+        die("volume size is not suitable for FAT16", NULL);
+    }
+
+    bpb_struct *bpb = &vol->bpb;
+    bpb->byte_per_sec = SECT_SIZE;
+    bpb->sec_per_clus = spc;
+    bpb->rsvd_sec_cnt = RSVD_SEC_CNT;
+    bpb->num_fats = NUM_FATS;
+    bpb->root_ent_cnt = ROOT_ENT_CNT;
+    bpb->tot_sec_16 = total_sectors < 0x10000 ? total_sectors : 0;
+    bpb->media = 0xF8;
+    bpb->sec_per_fat_16 = sec_per_fat;
+    bpb->sec_per_track = 63;
+    bpb->num_heads = 255;
+    bpb->hidd_sec = PART_START_LBA;
+    bpb->tot_sec_32 = total_sectors < 0x10000 ? 0 : total_sectors;
+
+    vol->fat_start = RSVD_SEC_CNT;
+    vol->root_start = vol->fat_start + NUM_FATS * sec_per_fat;
+    vol->data_start = vol->root_start + vol->root_sectors;
+    vol->cluster_count = clusters;
+    vol->clus_size = spc * SECT_SIZE;
+
+    fat_boot_sector *fbs = (fat_boot_sector *)base;
+    memcpy(fbs->jump_ins, "\xEB\x3C\x90", 3);
+    memcpy(fbs->OEM, "FIRSTSTP", 8);
+    fbs->bpb = *bpb;
+    fbs->ebpb.drv_num = 0x80;
+    fbs->ebpb.boot_sig = 0x29;
+    fbs->ebpb.vol_id = (uint32_t)time(NULL);
+    memcpy(fbs->ebpb.vol_lab, "FIRSTSTEP  ", 11);
+    memcpy(fbs->ebpb.fs_type, "FAT16   ", 8);
+    base[510] = 0x55;
+    base[511] = 0xAA;
+
+    for (int i = 0; i < NUM_FATS; i++)
+    {
+        fat_table(vol, i)[0] = 0xFF00 | bpb->media;
+        fat_table(vol, i)[1] = FAT16_EOC;
+    }
+}
+
+/**
+ * 为节点分配一段连续的簇
+ */
+static void alloc_clusters(const volume *vol, node *n, uint32_t *next_clus)
+{
+    uint32_t bytes = n->is_dir ? n->entry_count * sizeof(fat_dir_entry) : n->size;
+    n->clus_count = CEIL_DIV(bytes, vol->clus_size);
+    if (n->clus_count == 0)
+    {
+        n->fst_clus = 0;
+        return;
+    }
+    if (*next_clus + n->clus_count > vol->cluster_count + 2)
+    {
+        die("image is full", n->name);
+    }
+    n->fst_clus = *next_clus;
+    *next_clus += n->clus_count;
+
+    // 连续簇的链表：每个簇指向下一个簇，最后一个簇标记为结束
+    for (uint32_t i = 0; i < n->clus_count; i++)
+    {
+        uint16_t value = i + 1 < n->clus_count ? n->fst_clus + i + 1 : FAT16_EOC;
+        for (int t = 0; t < NUM_FATS; t++)
+        {
+            fat_table(vol, t)[n->fst_clus + i] = value;
+        }
+    }
+}
+
+// 按从根到叶的顺序，为尚未分配的上级目录分配簇
+static void alloc_parent_dirs(const volume *vol, node *n, uint32_t *next_clus)
+{
+    node *dir = n->parent;
+    if (dir == NULL || dir->parent == NULL || dir->clus_count != 0)
+    {
+        return;
+    }
+    alloc_parent_dirs(vol, dir, next_clus);
+    alloc_clusters(vol, dir, next_clus);
+}
+
+static void fill_entry(fat_dir_entry *entry, const char short_name[11], uint8_t attr, uint16_t clus, uint32_t size)
+{
+    time_t now = time(NULL);
+    struct tm *tm = localtime(&now);
+    uint16_t date = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+    uint16_t tm_val = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->name, short_name, 8);
+    memcpy(entry->ext, short_name + 8, 3);
+    entry->attr = attr;
+    entry->crt_time = entry->wrt_time = tm_val;
+    entry->crt_date = entry->wrt_date = entry->lst_acc_date = date;
+    entry->fst_clus = clus;
+    entry->file_size = size;
+}
+
+// 写入目录的条目
+static void write_dir(const volume *vol, const node *dir)
+{
+    fat_dir_entry *entry;
+    if (dir->parent == NULL)
+    {
+        entry = (fat_dir_entry *)(vol->base + vol->root_start * SECT_SIZE);
+    }
+    else
+    {
+        entry = (fat_dir_entry *)clus_data(vol, dir->fst_clus);
+        uint16_t parent_clus = dir->parent->parent == NULL ? 0 : dir->parent->fst_clus;
+        fill_entry(entry++, ".          ", FAT_ATTR_DIRECTORY, dir->fst_clus, 0);
+        fill_entry(entry++, "..         ", FAT_ATTR_DIRECTORY, parent_clus, 0);
+    }
+
+    for (const node *c = dir->child; c != NULL; c = c->sibling)
+    {
+        fill_entry(entry++, c->short_name, c->is_dir ? FAT_ATTR_DIRECTORY : FAT_ATTR_ARCHIVE,
+                   c->fst_clus, c->is_dir ? 0 : c->size);
+        if (c->is_dir)
+        {
+            write_dir(vol, c);
+        }
+    }
+}
+
+static long file_size(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        die("cannot open", path);
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+static void read_file(const char *path, uint8_t *dst, uint32_t size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL || fread(dst, 1, size, fp) != size)
+    {
+        die("cannot read", path);
+    }
+    fclose(fp);
+}
+
+static int build_image(const char *output, const char *manifest, uint32_t size_mib, uint32_t swap_mib)
+{
+    FILE *fp = fopen(manifest, "r");
+    if (fp == NULL)
+    {
+        die("cannot open", manifest);
+    }
+
+    // 读取清单，建立目录树，并按访问顺序记录文件
+    node *root = new_node("/", 1, NULL);
+    node **order = NULL;
+    size_t count = 0, capacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char src[512], dest[512];
+        char *p = line;
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (*p == '#' || *p == '\0')
+        {
+            continue;
+        }
+        if (sscanf(p, "%511s %511s", src, dest) != 2)
+        {
+            die("invalid manifest line", line);
+        }
+
+        node *n = add_path(root, strdup(dest));
+        n->src = strdup(src);
+        long size = file_size(n->src);
+        if (size < 0 || size > 0x7FFFFFFF)
+        {
+            die("invalid file size", n->src);
+        }
+        n->size = size;
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            order = realloc(order, capacity * sizeof(node *));
+        }
+        order[count++] = n;
+    }
+    fclose(fp);
+
+    if (root->entry_count > ROOT_ENT_CNT)
+    {
+        die("too many entries in root directory", NULL);
+    }
+
+    // 生成镜像：MBR 分区表 + FAT16 分区 + 交换分区（可选）
+    uint64_t image_size = (uint64_t)size_mib << 20;
+    uint32_t swap_sectors = ((uint64_t)swap_mib << 20) / SECT_SIZE;
+    uint32_t total_sectors = image_size / SECT_SIZE - PART_START_LBA - swap_sectors;
+    uint8_t *image = calloc(1, image_size);
+    if (image == NULL)
+    {
+        die("out of memory", NULL);
+    }
+
+    mbr_struct *mbr = (mbr_struct *)image;
+    mbr->partitions[0].boot_indicator = MBR_BOOTABLE_FLAG;
+    mbr->partitions[0].partition_type = PART_TYPE_FAT16_LBA;
+    memcpy(mbr->partitions[0].start_chs, "\xFE\xFF\xFF", 3); // 仅使用 LBA 寻址
+    memcpy(mbr->partitions[0].end_chs, "\xFE\xFF\xFF", 3);
+    mbr->partitions[0].start_lba = PART_START_LBA;
+    mbr->partitions[0].num_sectors = total_sectors;
+    if (swap_sectors > 0)
+    {
+        mbr->partitions[1].partition_type = PART_TYPE_LINUX_SWAP;
+        memcpy(mbr->partitions[1].start_chs, "\xFE\xFF\xFF", 3);
+        memcpy(mbr->partitions[1].end_chs, "\xFE\xFF\xFF", 3);
+        mbr->partitions[1].start_lba = PART_START_LBA + total_sectors;
+        mbr->partitions[1].num_sectors = swap_sectors;
+    }
+    mbr->signature = 0xAA55;
+
+    volume vol;
+    format_volume(&vol, image + PART_START_LBA * SECT_SIZE, total_sectors);
+
+    // 按访问顺序分配簇：目录紧挨在其首个文件之前，文件依次连续存放
+    uint32_t next_clus = 2;
+    for (size_t i = 0; i < count; i++)
+    {
+        alloc_parent_dirs(&vol, order[i], &next_clus);
+        alloc_clusters(&vol, order[i], &next_clus);
+        if (order[i]->size > 0)
+        {
+            read_file(order[i]->src, clus_data(&vol, order[i]->fst_clus), order[i]->size);
+        }
+    }
+    write_dir(&vol, root);
+
+    FILE *out = fopen(output, "wb");
+    if (out == NULL || fwrite(image, 1, image_size, out) != image_size || fclose(out) != 0)
+    {
+        die("cannot write", output);
+    }
+
+    printf("image '%s': %u MiB, %u MiB swap, %u bytes per cluster, %zu files, %u/%u clusters used\n",
+           output, size_mib, swap_mib, vol.clus_size, count, next_clus - 2, vol.cluster_count);
+    return 0;
+}
+
+/* ======================================== */
+
+// 碎片统计结果
+typedef struct frag_stats
+{
+    uint32_t files;
+    uint32_t fragmented_files;
+    uint32_t extents;
+    uint32_t clusters;
+} frag_stats;
+
+/**
+ * 统计簇链的簇数量和连续段数量
+ *
+ * 簇号来自镜像，损坏的镜像中可能超出数据区，遇到超出范围的簇号（包括结束标记）时停止
+ *
+ * @return 簇数量
+ */
+static uint32_t walk_chain(const volume *vol, uint16_t clus, uint32_t *extents)
+{
+    const uint16_t *fat = fat_table(vol, 0);
+    uint32_t count = 0;
+    *extents = 0;
+    uint16_t prev = 0;
+    while (clus >= 2 && clus <= vol->cluster_count + 1 && count <= vol->cluster_count)
+    {
+        if (prev == 0 || clus != prev + 1)
+        {
+            (*extents)++;
+        }
+        count++;
+        prev = clus;
+        clus = fat[clus];
+    }
+    return count;
+}
+
+static void scan_dir(const volume *vol, const fat_dir_entry *entries, uint32_t entry_count, const char *path, frag_stats *stats, int depth)
+{
+    for (uint32_t i = 0; i < entry_count; i++)
+    {
+        const fat_dir_entry *e = &entries[i];
+        if (e->name[0] == 0)
+        {
+            break;
+        }
+        if (e->name[0] == FAT_ENTRY_DELETED || e->name[0] == '.' ||
+            e->attr == FAT_ATTR_LFN || (e->attr & FAT_ATTR_VOLUME_ID))
+        {
+            continue;
+        }
+
+        // 拼接路径，去掉 8.3 名称的填充空格
+        char name[13];
+        int len = 0;
+        for (int k = 0; k < 8 && e->name[k] != ' '; k++)
+        {
+            name[len++] = e->name[k];
+        }
+        if (e->ext[0] != ' ')
+        {
+            name[len++] = '.';
+            for (int k = 0; k < 3 && e->ext[k] != ' '; k++)
+            {
+                name[len++] = e->ext[k];
+            }
+        }
+        name[len] = '\0';
+        char child_path[512];
+        snprintf(child_path, sizeof(child_path), "%s/%s", path, name);
+
+        uint32_t extents;
+        uint32_t clusters = walk_chain(vol, e->fst_clus, &extents);
+        // 序号在整个镜像中递增，不同目录中的条目也能区分
+        printf("%3u  %-32s %-4s %10u %8u %7u\n", stats->files, child_path,
+               (e->attr & FAT_ATTR_DIRECTORY) ? "dir" : "file",
+               e->file_size, clusters, extents);
+
+        stats->files++;
+        stats->extents += extents;
+        stats->clusters += clusters;
+        if (extents > 1)
+        {
+            stats->fragmented_files++;
+        }
+
+        if ((e->attr & FAT_ATTR_DIRECTORY) && clusters > 0 && depth < 16)
+        {
+            // 将目录的簇链读入连续缓冲区再遍历
+            fat_dir_entry *buf = malloc(clusters * vol->clus_size);
+            const uint16_t *fat = fat_table(vol, 0);
+            uint16_t clus = e->fst_clus;
+            for (uint32_t k = 0; k < clusters; k++, clus = fat[clus])
+            {
+                memcpy((uint8_t *)buf + k * vol->clus_size, clus_data(vol, clus), vol->clus_size);
+            }
+            scan_dir(vol, buf, clusters * vol->clus_size / sizeof(fat_dir_entry), child_path, stats, depth + 1);
+            free(buf);
+        }
+    }
+}
+
+static int report_fragmentation(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        die("cannot open", path);
+    }
+    fseek(fp, 0, SEEK_END);
+    long image_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *image = malloc(image_size);
+    if (image == NULL || fread(image, 1, image_size, fp) != (size_t)image_size)
+    {
+        die("cannot read", path);
+    }
+    fclose(fp);
+
+    // 与内核相同，使用首个引导分区
+    const mbr_struct *mbr = (const mbr_struct *)image;
+    const partition_entry *part = NULL;
+    for (int i = 0; i < 4; i++)
+    {
+        if (mbr->partitions[i].boot_indicator == MBR_BOOTABLE_FLAG)
+        {
+            part = &mbr->partitions[i];
+            break;
+        }
+    }
+    if (part == NULL || (uint64_t)part->start_lba * SECT_SIZE + SECT_SIZE > (uint64_t)image_size)
+    {
+        die("no bootable partition found", path);
+    }
+
+    volume vol = {.base = image + (uint64_t)part->start_lba * SECT_SIZE};
+    const fat_boot_sector *fbs = (const fat_boot_sector *)vol.base;
+    if (memcmp(fbs->ebpb.fs_type, "FAT16", 5) != 0)
+    {
+        die("partition file system is not FAT16", path);
+    }
+    vol.bpb = fbs->bpb;
+    vol.fat_start = vol.bpb.rsvd_sec_cnt;
+    vol.root_start = vol.fat_start + vol.bpb.num_fats * vol.bpb.sec_per_fat_16;
+    vol.root_sectors = CEIL_DIV(vol.bpb.root_ent_cnt * sizeof(fat_dir_entry), SECT_SIZE);
+    vol.data_start = vol.root_start + vol.root_sectors;
+    vol.clus_size = vol.bpb.sec_per_clus * SECT_SIZE;
+    uint32_t total_sectors = vol.bpb.tot_sec_16 ? vol.bpb.tot_sec_16 : vol.bpb.tot_sec_32;
+    if ((uint64_t)part->start_lba * SECT_SIZE + (uint64_t)total_sectors * SECT_SIZE > (uint64_t)image_size)
+    {
+        die("partition exceeds image size", path);
+    }
+    if (vol.bpb.sec_per_clus == 0 || vol.data_start > total_sectors)
+    {
+        die("invalid FAT16 layout", path);
+    }
+    vol.cluster_count = (total_sectors - vol.data_start) / vol.bpb.sec_per_clus;
+    // 簇号 2 ~ cluster_count + 1 都要在 FAT 表中有对应的表项，walk_chain 据此限制簇号
+    if (vol.cluster_count + 2 > vol.bpb.sec_per_fat_16 * SECT_SIZE / sizeof(uint16_t))
+    {
+        die("FAT table too small for the data area", path);
+    }
+
+    printf("idx  %-32s %-4s %10s %8s %7s\n", "path", "type", "size", "clusters", "extents");
+    frag_stats stats = {0};
+    scan_dir(&vol, (const fat_dir_entry *)(vol.base + vol.root_start * SECT_SIZE),
+             vol.bpb.root_ent_cnt, "", &stats, 0);
+
+    printf("\n%u entries, %u clusters, %u extents, %u fragmented (%.1f%%), %.2f extents per entry\n",
+           stats.files, stats.clusters, stats.extents, stats.fragmented_files,
+           stats.files ? 100.0 * stats.fragmented_files / stats.files : 0.0,
+           stats.files ? (double)stats.extents / stats.files : 0.0);
+    free(image);
+    return 0;
+}
+
+/* ======================================== */
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL, *frag_image = NULL, *manifest = NULL;
+    uint32_t size_mib = 16;
+    uint32_t swap_mib = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            size_mib = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            swap_mib = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            frag_image = argv[++i];
+        }
+        else if (manifest == NULL && argv[i][0] != '-')
+        {
+            manifest = argv[i];
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (frag_image != NULL)
+    {
+        return report_fragmentation(frag_image);
+    }
+    if (output == NULL || manifest == NULL || size_mib < swap_mib + 2)
+    {
+        usage();
+    }
+    return build_image(output, manifest, size_mib, swap_mib);
+}
@@ -0,0 +1,372 @@
+/**
+ * romfs 镜像打包工具（宿主机程序）
+ *
+ * 将文件打包为只读的 romfs 镜像，内核启动时整体读入内存并挂载
+ * 文件按路径排序，数据按页对齐存放，并生成路径哈希表，使内核查找文件只需一次哈希探测
+ *
+ * 镜像格式参考 inc/kernel/romfs.h
+ * 由于宿主机的标准库类型与内核的 types.h 冲突，此处单独定义结构体，修改时需要保持一致
+ *
+ * Usage: mkromfs [-z] -o <image> <src_file>:<dest_path> ...
+ *   -z 使用 LZ4 压缩文件数据（仅当压缩后更小时生效）
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ROMFS_MAGIC 0x53464F52U
+#define ROMFS_VERSION 1
+#define ROMFS_ALIGN 4096
+#define ROMFS_FLAG_LZ4 0x1
+
+#define ALIGN_UP(x, align) (((x) + (align) - 1) / (align) * (align))
+
+typedef struct romfs_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t image_size;
+    uint32_t entry_count;
+    uint32_t hash_size;
+    uint32_t hash_offset;
+    uint32_t entry_offset;
+    uint32_t name_offset;
+} __attribute__((packed)) romfs_header;
+
+typedef struct romfs_entry
+{
+    uint32_t hash;
+    uint32_t name_offset;
+    uint32_t name_len;
+    uint32_t flags;
+    uint32_t data_offset;
+    uint32_t size;
+    uint32_t stored_size;
+    uint32_t reserved;
+} __attribute__((packed)) romfs_entry;
+
+// 待打包的文件
+typedef struct input_file
+{
+    const char *src;  // 宿主机文件路径
+    const char *dest; // 镜像内绝对路径
+    uint8_t *data;    // 写入镜像的数据（可能已压缩）
+    uint32_t size;    // 文件原始大小
+    uint32_t stored_size;
+    uint32_t flags;
+} input_file;
+
+/* ======================================== */
+
+// 与 inc/kernel/romfs.h 中的 romfs_hash 一致
+static uint32_t romfs_hash(const char *path)
+{
+    uint32_t hash = 2166136261U;
+    while (*path)
+    {
+        hash ^= (uint8_t)*(path++);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* ======================================== */
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_MFLIMIT 12     // 最后一个匹配必须在数据结尾 12 字节之前开始
+#define LZ4_LAST_LITERALS 5 // 数据结尾 5 字节必须是字面量
+#define LZ4_HASH_BITS 12
+#define LZ4_MAX_OFFSET 65535
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 写入 LZ4 变长长度字段的扩展部分
+static uint8_t *write_length(uint8_t *op, size_t len)
+{
+    while (len >= 255)
+    {
+        *(op++) = 255;
+        len -= 255;
+    }
+    *(op++) = (uint8_t)len;
+    return op;
+}
+
+// 写入一个序列，match_len 为 0 表示最后一个只有字面量的序列
+static uint8_t *write_sequence(uint8_t *op, const uint8_t *literal, size_t literal_len, size_t offset, size_t match_len)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t)((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15)
+    {
+        op = write_length(op, literal_len - 15);
+    }
+    memcpy(op, literal, literal_len);
+    op += literal_len;
+
+    if (match_len == 0)
+    {
+        return op;
+    }
+
+    *(op++) = offset & 0xFF;
+    *(op++) = (offset >> 8) & 0xFF;
+    match_len -= LZ4_MIN_MATCH;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+    if (match_len >= 15)
+    {
+        op = write_length(op, match_len - 15);
+    }
+    return op;
+}
+
+/**
+ * LZ4 块格式压缩（贪心匹配）
+ *
+ * @param dst 缓冲区大小至少为 size + size / 255 + 16
+ * @return 压缩后的字节数
+ */
+static size_t lz4_compress(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    static int64_t table[1 << LZ4_HASH_BITS];
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        table[i] = -1;
+    }
+
+    uint8_t *op = dst;
+    size_t anchor = 0, ip = 0;
+
+    if (size > LZ4_MFLIMIT)
+    {
+        const size_t mflimit = size - LZ4_MFLIMIT;
+        const size_t matchlimit = size - LZ4_LAST_LITERALS;
+
+        while (ip < mflimit)
+        {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+            int64_t ref = table[h];
+            table[h] = ip;
+
+            if (ref < 0 || ip - ref > LZ4_MAX_OFFSET || read32(src + ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            size_t len = LZ4_MIN_MATCH;
+            while (ip + len < matchlimit && src[ref + len] == src[ip + len])
+            {
+                len++;
+            }
+
+            op = write_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, src + anchor, size - anchor, 0, 0);
+    return op - dst;
+}
+
+/* ======================================== */
+
+static void die(const char *msg, const char *arg)
+{
+    fprintf(stderr, "mkromfs: %s%s%s\n", msg, arg ? ": " : "", arg ? arg : "");
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mkromfs [-z] -o <image> <src_file>:<dest_path> ...\n");
+    exit(1);
+}
+
+static int cmp_dest(const void *a, const void *b)
+{
+    return strcmp(((const input_file *)a)->dest, ((const input_file *)b)->dest);
+}
+
+static void load_file(input_file *file, int compress)
+{
+    FILE *fp = fopen(file->src, "rb");
+    if (fp == NULL)
+    {
+        die("cannot open", file->src);
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0)
+    {
+        die("cannot read", file->src);
+    }
+
+    uint8_t *data = malloc(size + 1);
+    if (data == NULL || fread(data, 1, size, fp) != (size_t)size)
+    {
+        die("cannot read", file->src);
+    }
+    fclose(fp);
+
+    file->data = data;
+    file->size = size;
+    file->stored_size = size;
+    file->flags = 0;
+
+    if (compress && size > 0)
+    {
+        uint8_t *packed = malloc(size + size / 255 + 16);
+        if (packed == NULL)
+        {
+            die("out of memory", NULL);
+        }
+        size_t packed_size = lz4_compress(data, size, packed);
+        if (packed_size < (size_t)size)
+        {
+            free(data);
+            file->data = packed;
+            file->stored_size = packed_size;
+            file->flags |= ROMFS_FLAG_LZ4;
+        }
+        else
+        {
+            free(packed);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    int compress = 0;
+    input_file *files = calloc(argc, sizeof(input_file));
+    uint32_t count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-z") == 0)
+        {
+            compress = 1;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            char *sep = strchr(argv[i], ':');
+            if (sep == NULL || sep[1] != '/')
+            {
+                usage();
+            }
+            *sep = '\0';
+            files[count].src = argv[i];
+            files[count].dest = sep + 1;
+            count++;
+        }
+    }
+    if (output == NULL || count == 0)
+    {
+        usage();
+    }
+
+    // 按路径排序，并检查重复路径
+    qsort(files, count, sizeof(input_file), cmp_dest);
+    for (uint32_t i = 1; i < count; i++)
+    {
+        if (strcmp(files[i - 1].dest, files[i].dest) == 0)
+        {
+            die("duplicate path", files[i].dest);
+        }
+    }
+
+    // 哈希表大小取不小于两倍条目数量的 2 的幂，保证探测链较短且必有空槽位
+    uint32_t hash_size = 1;
+    while (hash_size < count * 2)
+    {
+        hash_size <<= 1;
+    }
+
+    // 计算镜像布局
+    uint32_t names_size = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        load_file(&files[i], compress);
+        names_size += strlen(files[i].dest);
+    }
+
+    romfs_header header = {
+        .magic = ROMFS_MAGIC,
+        .version = ROMFS_VERSION,
+        .entry_count = count,
+        .hash_size = hash_size,
+    };
+    header.hash_offset = sizeof(romfs_header);
+    header.entry_offset = header.hash_offset + hash_size * sizeof(uint32_t);
+    header.name_offset = header.entry_offset + count * sizeof(romfs_entry);
+
+    uint32_t data_offset = ALIGN_UP(header.name_offset + names_size, ROMFS_ALIGN);
+    romfs_entry *entries = calloc(count, sizeof(romfs_entry));
+    uint32_t name_offset = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        entries[i].hash = romfs_hash(files[i].dest);
+        entries[i].name_offset = name_offset;
+        entries[i].name_len = strlen(files[i].dest);
+        entries[i].flags = files[i].flags;
+        entries[i].data_offset = data_offset;
+        entries[i].size = files[i].size;
+        entries[i].stored_size = files[i].stored_size;
+
+        name_offset += entries[i].name_len;
+        data_offset = ALIGN_UP(data_offset + files[i].stored_size, ROMFS_ALIGN);
+    }
+    header.image_size = data_offset;
+
+    // 填充镜像内容
+    uint8_t *image = calloc(1, header.image_size);
+    if (image == NULL)
+    {
+        die("out of memory", NULL);
+    }
+    memcpy(image, &header, sizeof(header));
+
+    uint32_t *hash_table = (uint32_t *)(image + header.hash_offset);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t slot = entries[i].hash & (hash_size - 1);
+        while (hash_table[slot] != 0)
+        {
+            slot = (slot + 1) & (hash_size - 1);
+        }
+        hash_table[slot] = i + 1;
+
+        memcpy(image + header.name_offset + entries[i].name_offset, files[i].dest, entries[i].name_len);
+        memcpy(image + entries[i].data_offset, files[i].data, files[i].stored_size);
+    }
+    memcpy(image + header.entry_offset, entries, count * sizeof(romfs_entry));
+
+    FILE *fp = fopen(output, "wb");
+    if (fp == NULL || fwrite(image, 1, header.image_size, fp) != header.image_size || fclose(fp) != 0)
+    {
+        die("cannot write", output);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf("%-24s %8u -> %8u%s\n", files[i].dest, files[i].size, files[i].stored_size,
+               (files[i].flags & ROMFS_FLAG_LZ4) ? " (lz4)" : "");
+    }
+    printf("romfs image '%s': %u files, %u bytes\n", output, count, header.image_size);
+    return 0;
+}
@@ -0,0 +1,541 @@
+/**
+ * 物理页分配器压力测试（宿主机程序）
+ *
+ * 直接编译 kernel/pmu.c 中的伙伴系统，与原先基于有序链表和固定节点池的实现对比
+ * batch 是伙伴系统加上 pmu_batch 批量释放，与逐页释放对比
+ * 内核代码使用 32 位地址，所以测试内存通过 MAP_32BIT 申请在 4 GiB 以内
+ * 内核的 types.h 与宿主机标准库冲突，所以不包含标准库头文件，手动声明需要的函数
+ *
+ * Usage: pmu_bench [MiB]
+ */
+#define memset bench_memset
+#define printk printf
+#include "../kernel/pmu.c"
+#undef memset
+
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_PRIVATE 0x02
+#define MAP_ANONYMOUS 0x20
+#define MAP_32BIT 0x40
+#define CLOCK_MONOTONIC 1
+
+struct timespec
+{
+    long tv_sec;
+    long tv_nsec;
+};
+
+int printf(const char *fmt, ...);
+int atoi(const char *str);
+void exit(int status);
+void *mmap(void *addr, unsigned long len, int prot, int flags, int fd, long offset);
+int clock_gettime(int clock, struct timespec *ts);
+
+static void *panic_jmp[5]; // __builtin_setjmp 的缓冲区
+static int panic_armed = 0;
+
+void *bench_memset(void *s, int c, size_t n)
+{
+    uint8_t *p = s;
+    while (n--)
+    {
+        *(p++) = c;
+    }
+    return s;
+}
+
+// 测试过程中的 panic 视为该分配器失败，跳回测试入口
+void panic(const char *fmt, ...)
+{
+    if (panic_armed)
+    {
+        __builtin_longjmp(panic_jmp, 1);
+    }
+    printf("panic: %s\n", fmt);
+    exit(1);
+}
+
+void assertion_failed(const char *exp, const char *file, const char *base, int line)
+{
+    printf("assertion failed: %s (%s:%d)\n", exp, file, line);
+    exit(1);
+}
+
+void debug_print(const char *file, int line, const char *fmt, ...)
+{
+}
+
+// 测试内存都在低端内存，不需要临时映射
+void *kmap(uint32_t p_addr)
+{
+    return (void *)(unsigned long)p_addr;
+}
+
+void kunmap(void *addr)
+{
+}
+
+// 测试中没有缓存和用户页可以回收，也没有任务可以结束
+void register_shrinker(shrinker *s)
+{
+}
+
+size_t shrink_caches(size_t count)
+{
+    return 0;
+}
+
+size_t reclaim_pages(size_t count)
+{
+    return 0;
+}
+
+void reclaim_wakeup(void)
+{
+}
+
+int oom_kill(void)
+{
+    return -1;
+}
+
+/* ======================================== */
+
+/**
+ * 原先的实现（有序链表 + 1024 个节点的缓冲池），仅修改了名字
+ */
+
+#define NODE_COUNT 1024
+
+typedef struct page_node
+{
+    uint32_t addr;
+    size_t count;
+    struct page_node *next;
+} page_node;
+
+static page_node node_buf[NODE_COUNT];
+static uint8_t bitmap[(NODE_COUNT + 7) / 8];
+
+static struct
+{
+    size_t count;
+    page_node *head;
+} list = {.count = 0, .head = NULL};
+
+static page_node *alloc_node(uint32_t addr, size_t count)
+{
+    for (int i = 0; i < NODE_COUNT; i++)
+    {
+        if (!((bitmap[i / 8] >> (i % 8)) & 1))
+        {
+            bitmap[i / 8] |= (1 << (i % 8));
+            node_buf[i].addr = addr;
+            node_buf[i].count = count;
+            node_buf[i].next = NULL;
+            return node_buf + i;
+        }
+    }
+    panic("page node buffer exhausted");
+    return NULL;
+}
+
+static void free_node(page_node *node)
+{
+    int i = node - node_buf;
+    bitmap[i / 8] &= ~(1 << (i % 8));
+    node->count = 0;
+    node->addr = 0;
+    node->next = NULL;
+}
+
+static void list_add_record(uint32_t addr, size_t count)
+{
+    list.count += count;
+
+    if (list.head == NULL)
+    {
+        list.head = alloc_node(addr, count);
+        return;
+    }
+
+    page_node *p = NULL, *p_pre = NULL, *p_next = list.head;
+    while (p_next != NULL && addr > p_next->addr)
+    {
+        p_pre = p_next;
+        p_next = p_next->next;
+    }
+
+    if (p_next != NULL && addr + count * PAGE_SIZE == p_next->addr)
+    {
+        p_next->addr = addr;
+        p_next->count += count;
+        p = p_next;
+        p_next = p_next->next;
+    }
+    else
+    {
+        p = alloc_node(addr, count);
+        p->next = p_next;
+        if (p_pre == NULL)
+        {
+            list.head = p;
+        }
+        else
+        {
+            p_pre->next = p;
+        }
+    }
+
+    if (p_pre != NULL && p_pre->addr + p_pre->count * PAGE_SIZE == addr)
+    {
+        p_pre->count += p->count;
+        free_node(p);
+        p_pre->next = p_next;
+    }
+}
+
+static uint32_t list_alloc_contiguous(size_t count)
+{
+    page_node *p_pre = NULL;
+    for (page_node *p = list.head; p != NULL; p_pre = p, p = p->next)
+    {
+        if (p->count < count)
+        {
+            continue;
+        }
+
+        uint32_t addr = p->addr;
+        p->addr += count * PAGE_SIZE;
+        p->count -= count;
+        list.count -= count;
+
+        if (p->count == 0)
+        {
+            if (p_pre == NULL)
+            {
+                list.head = p->next;
+            }
+            else
+            {
+                p_pre->next = p->next;
+            }
+            free_node(p);
+        }
+        return addr;
+    }
+    return 0;
+}
+
+static uint32_t list_alloc(void)
+{
+    if (list.count == 0)
+    {
+        panic("No free page");
+    }
+    return list_alloc_contiguous(1);
+}
+
+static void list_free(uint32_t addr)
+{
+    list_add_record(addr, 1);
+}
+
+static void list_free_contiguous(uint32_t addr, size_t count)
+{
+    list_add_record(addr, count);
+}
+
+static size_t list_free_count(void)
+{
+    return list.count;
+}
+
+static void list_init(uint32_t addr, size_t count)
+{
+    list.count = 0;
+    list.head = NULL;
+    bench_memset(node_buf, 0, sizeof(node_buf));
+    bench_memset(bitmap, 0, sizeof(bitmap));
+    list_add_record(addr, count);
+}
+
+/* ======================================== */
+
+// 整个测试内存都是可用内存
+static void buddy_init(uint32_t addr, size_t count)
+{
+    pmu_init(addr, count);
+    pmu_add_range(addr, count);
+}
+
+/**
+ * 伙伴系统的批量释放，释放的页积攒在批次中，满时排序合并后释放
+ * 查询空闲页数量前先释放批次中剩余的页
+ */
+static pmu_batch bench_batch;
+
+static void batch_init(uint32_t addr, size_t count)
+{
+    buddy_init(addr, count);
+    pmu_batch_init(&bench_batch);
+}
+
+static void batch_free(uint32_t addr)
+{
+    pmu_batch_add(&bench_batch, addr);
+}
+
+static size_t batch_free_count(void)
+{
+    pmu_batch_flush(&bench_batch);
+    return pmu_free_count();
+}
+
+typedef struct allocator
+{
+    const char *name;
+    void (*init)(uint32_t addr, size_t count);
+    uint32_t (*alloc)(void);
+    void (*free)(uint32_t addr);
+    uint32_t (*alloc_contiguous)(size_t count);
+    void (*free_contiguous)(uint32_t addr, size_t count);
+    size_t (*free_count)(void);
+} allocator;
+
+static const allocator allocators[] = {
+    {"list", list_init, list_alloc, list_free, list_alloc_contiguous, list_free_contiguous, list_free_count},
+    {"buddy", buddy_init, pmu_alloc, pmu_free, pmu_alloc_contiguous, pmu_free_contiguous, pmu_free_count},
+    {"batch", batch_init, pmu_alloc, batch_free, pmu_alloc_contiguous, pmu_free_contiguous, batch_free_count},
+};
+
+#define MAX_LIVE 65536
+
+static uint32_t live_addr[MAX_LIVE];
+static uint32_t live_count[MAX_LIVE];
+static uint32_t rand_state;
+
+static uint32_t xorshift32(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// 在页开头写入自身地址，释放时校验，用于发现重复分配
+static void stamp(uint32_t addr)
+{
+    *(uint32_t *)(unsigned long)addr = addr;
+}
+
+static void check_stamp(uint32_t addr)
+{
+    if (*(uint32_t *)(unsigned long)addr != addr)
+    {
+        printf("page %#x handed out twice\n", addr);
+        exit(1);
+    }
+}
+
+/**
+ * 单页随机申请释放
+ *
+ * 先申请 live 个页，然后反复随机释放其中一页再申请一页
+ * 释放留下的空洞会被下一次申请立刻填上，链表始终很短，是链表实现的最好情况
+ */
+static void case_single(const allocator *a, size_t live, size_t ops)
+{
+    for (size_t i = 0; i < live; i++)
+    {
+        live_addr[i] = a->alloc();
+        stamp(live_addr[i]);
+    }
+    for (size_t i = 0; i < ops; i++)
+    {
+        size_t slot = xorshift32() % live;
+        check_stamp(live_addr[slot]);
+        a->free(live_addr[slot]);
+        live_addr[slot] = a->alloc();
+        stamp(live_addr[slot]);
+    }
+    for (size_t i = 0; i < live; i++)
+    {
+        a->free(live_addr[i]);
+    }
+}
+
+// 1~16 页的连续内存随机申请释放
+static void case_multi(const allocator *a, size_t live, size_t ops)
+{
+    for (size_t i = 0; i < live; i++)
+    {
+        live_count[i] = 1 + xorshift32() % 16;
+        live_addr[i] = a->alloc_contiguous(live_count[i]);
+        stamp(live_addr[i]);
+    }
+    for (size_t i = 0; i < ops; i++)
+    {
+        size_t slot = xorshift32() % live;
+        check_stamp(live_addr[slot]);
+        a->free_contiguous(live_addr[slot], live_count[slot]);
+        live_count[slot] = 1 + xorshift32() % 16;
+        live_addr[slot] = a->alloc_contiguous(live_count[slot]);
+        if (live_addr[slot] == 0)
+        {
+            panic("No contiguous pages");
+        }
+        stamp(live_addr[slot]);
+    }
+    for (size_t i = 0; i < live; i++)
+    {
+        a->free_contiguous(live_addr[i], live_count[i]);
+    }
+}
+
+/**
+ * 两个进程交替申请 live 页，然后其中一个进程退出并释放所有页
+ * 模拟进程退出后留下大量不连续的空洞
+ */
+static void case_interleave(const allocator *a, size_t live, size_t ops)
+{
+    for (size_t round = 0; round < ops / (live * 2); round++)
+    {
+        for (size_t i = 0; i < live * 2; i++)
+        {
+            live_addr[i] = a->alloc();
+            stamp(live_addr[i]);
+        }
+        for (size_t i = 0; i < live * 2; i += 2)
+        {
+            check_stamp(live_addr[i]);
+            a->free(live_addr[i]);
+        }
+        for (size_t i = 1; i < live * 2; i += 2)
+        {
+            check_stamp(live_addr[i]);
+            a->free(live_addr[i]);
+        }
+    }
+}
+
+/**
+ * 进程申请 live 页后退出，按申请顺序释放所有页
+ * 进程的页通常是连续申请的，物理地址大多相邻，批量释放可以按大块归还
+ */
+static void case_exit(const allocator *a, size_t live, size_t ops)
+{
+    for (size_t round = 0; round < ops / live; round++)
+    {
+        for (size_t i = 0; i < live; i++)
+        {
+            live_addr[i] = a->alloc();
+            stamp(live_addr[i]);
+        }
+        for (size_t i = 0; i < live; i++)
+        {
+            check_stamp(live_addr[i]);
+            a->free(live_addr[i]);
+        }
+    }
+}
+
+// 申请全部内存后隔页释放，再全部释放，空闲内存碎片数量达到上限
+static void case_checkerboard(const allocator *a, size_t live, size_t ops)
+{
+    size_t count = 0;
+    while (count < MAX_LIVE && a->free_count() > 0)
+    {
+        live_addr[count++] = a->alloc();
+    }
+    for (size_t i = 0; i < count; i += 2)
+    {
+        a->free(live_addr[i]);
+    }
+    for (size_t i = 1; i < count; i += 2)
+    {
+        a->free(live_addr[i]);
+    }
+}
+
+typedef struct bench_case
+{
+    const char *name;
+    void (*run)(const allocator *a, size_t live, size_t ops);
+    size_t live;
+    size_t ops;
+} bench_case;
+
+/**
+ * 运行测试，输出平均每次操作的耗时
+ * 结束后检查所有页都已归还
+ */
+static void run_case(const allocator *a, const bench_case *c, uint32_t base, size_t pages)
+{
+    a->init(base, pages);
+    size_t initial = a->free_count();
+    rand_state = 2463534242U;
+
+    panic_armed = 1;
+    if (__builtin_setjmp(panic_jmp))
+    {
+        panic_armed = 0;
+        printf("  %-8s %-14s FAILED (panic)\n", a->name, c->name);
+        return;
+    }
+
+    long start = now_ns();
+    c->run(a, c->live, c->ops);
+    long elapsed = now_ns() - start;
+    panic_armed = 0;
+
+    size_t total_ops = c->ops ? c->ops * 2 : pages * 2;
+    printf("  %-8s %-14s %8.1f ns/op  %s\n", a->name, c->name, (double)elapsed / total_ops,
+           a->free_count() == initial ? "ok" : "LEAK");
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mib = argc > 1 ? atoi(argv[1]) : 64;
+    size_t pages = mib * 1024 * 1024 / PAGE_SIZE;
+    if (pages == 0 || pages > MAX_LIVE)
+    {
+        printf("Usage: pmu_bench [MiB], at most %d MiB\n", MAX_LIVE * PAGE_SIZE >> 20);
+        return 1;
+    }
+
+    void *mem = mmap(NULL, pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (mem == (void *)-1L)
+    {
+        printf("mmap failed\n");
+        return 1;
+    }
+    uint32_t base = (uint32_t)(unsigned long)mem;
+
+    const bench_case cases[] = {
+        {"single/256", case_single, 256, 1000000},
+        {"single/4096", case_single, 4096, 1000000},
+        {"multi/256", case_multi, 256, 1000000},
+        {"interleave/512", case_interleave, 512, 1000000},
+        {"exit/1024", case_exit, 1024, 1000000},
+        {"checkerboard", case_checkerboard, 0, 0},
+    };
+
+    printf("pmu_bench: %u MiB, %u pages\n", (uint32_t)mib, (uint32_t)pages);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(allocators) / sizeof(allocators[0]); j++)
+        {
+            run_case(&allocators[j], &cases[i], base, pages);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/**
+ * 任务切换开销测试
+ *
+ * 1. 只有一个任务时反复 yield，调度器选中的仍是自己，不切换页目录，作为系统调用和调度本身的基准开销
+ * 2. fork 出子进程后两个任务交替 yield，每次都切换页目录
+ * 两者之差即为切换页目录及之后重新填充 TLB 的开销
+ * 内核启用全局页时，切换页目录不会清空内核映射的 TLB 条目，可以使用 -DNO_PGE 编译内核进行对比
+ *
+ * 需要 CPU 支持 rdtsc 指令，结果受时钟中断影响，多运行几次取较小值
+ */
+#include "stdio.h"
+#include "unistd.h"
+
+#define ROUNDS 10000
+
+static inline uint32_t rdtsc(void)
+{
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return low;
+}
+
+int main(void)
+{
+    // 单任务基准
+    uint32_t start = rdtsc();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        yield();
+    }
+    uint32_t self_cycles = rdtsc() - start;
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        printf("fork failed\n");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            yield();
+        }
+        exit(0);
+    }
+
+    // 两个任务交替执行，每轮切换两次
+    start = rdtsc();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        yield();
+    }
+    uint32_t switch_cycles = rdtsc() - start;
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    printf("yield to self: %u cycles\n", self_cycles / ROUNDS);
+    printf("task switch:   %u cycles\n", switch_cycles / ROUNDS / 2);
+    meminfo();
+    return 0;
+}
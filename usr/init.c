@@ -5,36 +5,25 @@
 int main(void)
 {
     printf("init process %d\n", getpid());
-    pid_t pid = fork();
+
+    // 直接从可执行文件创建子进程，不需要先 fork 复制 init 的地址空间
+    pid_t pid = spawnl("/bin/hello", NULL);
     if (pid == -1)
     {
-        printf("fork failed\n");
+        printf("spawn failed\n");
         return -1;
     }
-    else if (pid == 0)
-    {
-        // child process
-        printf("child process %d\n", getpid());
-        if (execl("/bin/hello", NULL) == -1)
-        {
-            printf("execve failed\n");
-            return -1;
-        }
-    }
-    else
+    printf("spawned child process %d\n", pid);
+
+    int status;
+    while (1)
     {
-        // parent process
-        printf("parent process %d\n", getpid());
-        int status;
-        while (1)
+        pid_t wpid = wait(&status);
+        if (wpid != -1)
         {
-            pid_t wpid = wait(&status);
-            if (wpid != -1)
-            {
-                printf("child process %d exited with status %d\n", wpid, status);
-            }
+            printf("child process %d exited with status %d\n", wpid, status);
         }
     }
 
     return 0;
-}
\ No newline at end of file
+}